@@ -5,6 +5,11 @@
 
 enum {SEEK_SET, SEEK_CUR, SEEK_END};
 
+/* the number of file descriptors of a process */
+#define NR_FD 32
+
+typedef struct OpenFile OpenFile;
+
 int fs_open(const char *pathname, int flags, int mode);
 ssize_t fs_read(int fd, void *buf, size_t count);
 ssize_t fs_write(int fd, const void *buf, size_t count);
@@ -3,6 +3,7 @@
 
 #include "common.h"
 #include "memory.h"
+#include "fs.h"
 
 #define STACK_SIZE (8 * PGSIZE)
 
@@ -14,6 +15,8 @@ typedef union {
     uintptr_t cur_brk;
     // we do not free memory, so use `max_brk' to determine when to call _map()
     uintptr_t max_brk;
+    // the open files of the process, stdin, stdout and stderr if NULL
+    OpenFile *fd[NR_FD];
   };
 } PCB;
 
@@ -1,12 +1,22 @@
 #include "fs.h"
+#include "proc.h"
 
 typedef struct {
   char *name;
   size_t size;
   off_t disk_offset;
-  off_t open_offset;
 } Finfo;
 
+/* A file opened by fs_open(). Each open has its own offset, and is
+ * referenced by a file descriptor of the process.
+ */
+struct OpenFile {
+  int file;
+  off_t offset;
+  int flags;
+  int ref;
+};
+
 enum {FD_STDIN, FD_STDOUT, FD_STDERR, FD_FB, FD_EVENTS, FD_DISPINFO, FD_NORMAL};
 
 /* This is the information about all files in disk. */
@@ -22,13 +32,68 @@ static Finfo file_table[] __attribute__((used)) = {
 
 #define NR_FILES (sizeof(file_table) / sizeof(file_table[0]))
 
+/* A hash table from the path to the index of the file plus 1, with
+ * linear probing. It is at most half full.
+ */
+#define NR_PATH_HASH (2 * NR_FILES + 1)
+static uint16_t path_hash[NR_PATH_HASH];
+
+static uint32_t hash(const char *s) {
+  uint32_t h = 2166136261u;
+  for (; *s; s ++) {
+    h = (h ^ (uint8_t)*s) * 16777619u;
+  }
+  return h % NR_PATH_HASH;
+}
+
+static int lookup(const char *pathname) {
+  uint32_t h;
+  for (h = hash(pathname); path_hash[h] != 0; h = (h + 1) % NR_PATH_HASH) {
+    int i = path_hash[h] - 1;
+    if (strcmp(file_table[i].name, pathname) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+#define NR_OPEN_FILE 64
+
+static OpenFile open_file[NR_OPEN_FILE];
+static OpenFile std_file[3] = { {FD_STDIN, 0, 0, 1}, {FD_STDOUT, 0, 0, 1}, {FD_STDERR, 0, 0, 1} };
+
+/* the file descriptors of the kernel, used before any process runs */
+static OpenFile *kernel_fd[NR_FD];
+
+static inline OpenFile** fd_table() {
+  return (current == NULL ? kernel_fd : current->fd);
+}
+
+static OpenFile* get_file(int fd) {
+  assert(fd >= 0 && fd < NR_FD);
+  OpenFile *f = fd_table()[fd];
+  if (f == NULL) {
+    assert(fd < 3);
+    f = &std_file[fd];
+  }
+  return f;
+}
+
 void init_fs() {
   // TODO: initialize the size of /dev/fb
   file_table[FD_FB].size = _screen.width * _screen.height * sizeof(uint32_t);
+
+  int i;
+  for (i = 0; i < NR_FILES; i ++) {
+    assert(lookup(file_table[i].name) == -1);
+    uint32_t h;
+    for (h = hash(file_table[i].name); path_hash[h] != 0; h = (h + 1) % NR_PATH_HASH);
+    path_hash[h] = i + 1;
+  }
 }
 
 size_t fs_filesz(int fd) {
-  return file_table[fd].size;
+  return file_table[get_file(fd)->file].size;
 }
 
 void ramdisk_read(void *, uint32_t, uint32_t);
@@ -38,43 +103,56 @@ void dispinfo_read(void *buf, off_t offset, size_t len);
 void fb_write(const void *buf, off_t offset, size_t len);
 
 int fs_open(const char *pathname, int flags, int mode) {
+  int file = lookup(pathname);
+  if (file == -1) {
+    panic("No such file: %s", pathname);
+  }
+
+  OpenFile **table = fd_table();
+  int fd;
+  for (fd = 3; fd < NR_FD && table[fd] != NULL; fd ++);
+  if (fd == NR_FD) {
+    panic("Too many open files");
+  }
+
   int i;
-  for (i = 0; i < NR_FILES; i ++) {
-    if (strcmp(file_table[i].name, pathname) == 0) {
-      file_table[i].open_offset = 0;
-      return i;
-    }
+  for (i = 0; i < NR_OPEN_FILE && open_file[i].ref != 0; i ++);
+  if (i == NR_OPEN_FILE) {
+    panic("Too many open files in the system");
   }
 
-  panic("No such file: %s", pathname);
-  return -1;
+  open_file[i] = (OpenFile) { .file = file, .offset = 0, .flags = flags, .ref = 1 };
+  table[fd] = &open_file[i];
+  return fd;
 }
 
 ssize_t fs_read(int fd, void *buf, size_t len) {
   assert(fd > 2);
-  if (fd == FD_EVENTS) {
+  OpenFile *of = get_file(fd);
+  if (of->file == FD_EVENTS) {
     return events_read(buf, len);
   }
 
-  Finfo *f = file_table + fd;
-  int remain_bytes = f->size - f->open_offset;
+  Finfo *f = file_table + of->file;
+  int remain_bytes = f->size - of->offset;
   int bytes_to_read = (remain_bytes > len ? len : remain_bytes);
 
-  if (fd == FD_DISPINFO) {
-    dispinfo_read(buf, f->disk_offset + f->open_offset, bytes_to_read);
+  if (of->file == FD_DISPINFO) {
+    dispinfo_read(buf, f->disk_offset + of->offset, bytes_to_read);
   }
   else {
-    ramdisk_read(buf, f->disk_offset + f->open_offset, bytes_to_read);
+    ramdisk_read(buf, f->disk_offset + of->offset, bytes_to_read);
   }
-  f->open_offset += bytes_to_read;
+  of->offset += bytes_to_read;
   return bytes_to_read;
 }
 
 ssize_t fs_write(int fd, const void *buf, size_t len) {
-  Finfo *f = file_table + fd;
-  int remain_bytes = f->size - f->open_offset;
+  OpenFile *of = get_file(fd);
+  Finfo *f = file_table + of->file;
+  int remain_bytes = f->size - of->offset;
   int bytes_to_write = (remain_bytes > len ? len : remain_bytes);
-  switch (fd) {
+  switch (of->file) {
     case FD_STDOUT:
     case FD_STDERR:
       for (int i = 0; i < len; i ++) {
@@ -84,23 +162,23 @@ ssize_t fs_write(int fd, const void *buf, size_t len) {
       return len;
 
     case FD_FB:
-      fb_write(buf, f->open_offset, bytes_to_write);
+      fb_write(buf, of->offset, bytes_to_write);
       break;
 
     default:
-      ramdisk_write(buf, f->disk_offset + f->open_offset, bytes_to_write);
+      ramdisk_write(buf, f->disk_offset + of->offset, bytes_to_write);
       break;
   }
 
-  f->open_offset += bytes_to_write;
+  of->offset += bytes_to_write;
 
   return bytes_to_write;
 }
 
 off_t fs_lseek(int fd, off_t offset, int whence) {
-  Finfo *f = file_table + fd;
-  int new_offset = f->open_offset;
-  int file_size = file_table[fd].size;
+  OpenFile *of = get_file(fd);
+  int new_offset = of->offset;
+  int file_size = file_table[of->file].size;
   switch (whence) {
     case SEEK_CUR: new_offset += offset; break;
     case SEEK_SET: new_offset = offset; break;
@@ -113,11 +191,17 @@ off_t fs_lseek(int fd, off_t offset, int whence) {
   else if (new_offset > file_size) {
     new_offset = file_size;
   }
-  f->open_offset = new_offset;
+  of->offset = new_offset;
 
   return new_offset;
 }
 
 int fs_close(int fd) {
+  assert(fd >= 0 && fd < NR_FD);
+  OpenFile **table = fd_table();
+  if (table[fd] != NULL) {
+    table[fd]->ref --;
+    table[fd] = NULL;
+  }
   return 0;
 }
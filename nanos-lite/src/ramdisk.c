@@ -1,5 +1,31 @@
 #include "common.h"
 
+#ifdef HAS_DISK
+
+/* The files are read from the disk on demand, instead of being linked
+ * into the kernel. The disk should be the image made by
+ * `make update', e.g. run NEMU with `-f build/ramdisk.img'.
+ */
+
+void ramdisk_read(void *buf, off_t offset, size_t len) {
+  _disk_read(buf, offset, len);
+}
+
+void ramdisk_write(const void *buf, off_t offset, size_t len) {
+  _disk_write(buf, offset, len);
+}
+
+void init_ramdisk() {
+  Log("disk info: size = %d bytes", (int)_disk_size());
+  assert(_disk_size() != 0);
+}
+
+size_t get_ramdisk_size() {
+  return _disk_size();
+}
+
+#else
+
 extern uint8_t ramdisk_start;
 extern uint8_t ramdisk_end;
 #define RAMDISK_SIZE ((&ramdisk_end) - (&ramdisk_start))
@@ -29,3 +55,5 @@ void init_ramdisk() {
 size_t get_ramdisk_size() {
   return RAMDISK_SIZE;
 }
+
+#endif
@@ -7,6 +7,13 @@
 /* You will define this macro in PA2 */
 //#define HAS_IOE
 
+#ifdef LIBNEMU
+/* libnemu has neither the debugger nor the built-in devices, see include/libnemu.h */
+#undef DEBUG
+#undef DIFF_TEST
+#undef HAS_IOE
+#endif
+
 #include "debug.h"
 #include "macro.h"
 
@@ -19,23 +19,44 @@ typedef struct {
     int32_t simm;
   };
   rtlreg_t val;
-  char str[OP_STR_SIZE];
 } Operand;
 
+/* Only the state used to execute the instruction is here, so it fits in
+ * a cache line. The text for the trace is in DecodeAsm.
+ */
 typedef struct {
   uint32_t opcode;
   vaddr_t seq_eip;  // sequential eip
+  vaddr_t jmp_eip;
+  bool is_jmp;
   bool is_operand_size_16;
   uint8_t ext_opcode;
-  bool is_jmp;
-  vaddr_t jmp_eip;
-  Operand src, dest, src2;
+  union {
+    struct { Operand src, dest, src2; };
+    Operand op[3];
+  };
+} DecodeInfo;
+
 #ifdef DEBUG
+/* The assembly of the instruction. It is only produced when the trace is
+ * on, that is, when it is printed or there is a log file.
+ */
+typedef struct {
+  bool is_on;
+  char op_str[3][OP_STR_SIZE];
   char assembly[80];
   char asm_buf[128];
   char *p;
+} DecodeAsm;
+
+extern DecodeAsm decoding_asm;
+
+#define op_str(operand) (decoding_asm.op_str[(operand) - decoding.op])
+#define op_sprintf(operand, ...) \
+  do { \
+    if (decoding_asm.is_on) { snprintf(op_str(operand), OP_STR_SIZE, __VA_ARGS__); } \
+  } while (0)
 #endif
-} DecodeInfo;
 
 typedef union {
   struct {
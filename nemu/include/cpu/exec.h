@@ -11,10 +11,12 @@ typedef void (*EHelper) (vaddr_t *);
 static inline uint32_t instr_fetch(vaddr_t *eip, int len) {
   uint32_t instr = vaddr_read(*eip, len);
 #ifdef DEBUG
-  uint8_t *p_instr = (void *)&instr;
-  int i;
-  for (i = 0; i < len; i ++) {
-    decoding.p += sprintf(decoding.p, "%02x ", p_instr[i]);
+  if (decoding_asm.is_on) {
+    uint8_t *p_instr = (void *)&instr;
+    int i;
+    for (i = 0; i < len; i ++) {
+      decoding_asm.p += sprintf(decoding_asm.p, "%02x ", p_instr[i]);
+    }
   }
 #endif
   (*eip) += len;
@@ -34,7 +36,12 @@ static inline const char* get_cc_name(int subcode) {
 }
 
 #ifdef DEBUG
-#define print_asm(...) Assert(snprintf(decoding.assembly, 80, __VA_ARGS__) < 80, "buffer overflow!")
+#define print_asm(...) \
+  do { \
+    if (decoding_asm.is_on) { \
+      Assert(snprintf(decoding_asm.assembly, 80, __VA_ARGS__) < 80, "buffer overflow!"); \
+    } \
+  } while (0)
 #else
 #define print_asm(...)
 #endif
@@ -42,12 +49,12 @@ static inline const char* get_cc_name(int subcode) {
 #define suffix_char(width) ((width) == 4 ? 'l' : ((width) == 1 ? 'b' : ((width) == 2 ? 'w' : '?')))
 
 #define print_asm_template1(instr) \
-  print_asm(str(instr) "%c %s", suffix_char(id_dest->width), id_dest->str)
+  print_asm(str(instr) "%c %s", suffix_char(id_dest->width), op_str(id_dest))
 
 #define print_asm_template2(instr) \
-  print_asm(str(instr) "%c %s,%s", suffix_char(id_dest->width), id_src->str, id_dest->str)
+  print_asm(str(instr) "%c %s,%s", suffix_char(id_dest->width), op_str(id_src), op_str(id_dest))
 
 #define print_asm_template3(instr) \
-  print_asm(str(instr) "%c %s,%s,%s", suffix_char(id_dest->width), id_src->str, id_src2->str, id_dest->str)
+  print_asm(str(instr) "%c %s,%s,%s", suffix_char(id_dest->width), op_str(id_src), op_str(id_src2), op_str(id_dest))
 
 #endif
@@ -30,6 +30,34 @@ typedef struct {
 
   vaddr_t eip;
 
+  union {
+    struct {
+      uint32_t CF : 1;
+      uint32_t    : 5;
+      uint32_t ZF : 1;
+      uint32_t SF : 1;
+      uint32_t    : 1;
+      uint32_t IF : 1;
+      uint32_t    : 1;
+      uint32_t OF : 1;
+    };
+    uint32_t val;
+  } eflags;
+
+  uint16_t cs;
+
+  /* the IDT, loaded by `lidt' */
+  struct {
+    uint16_t limit;
+    uint32_t base;
+  } idtr;
+
+  /* the INTR pin, set by the interrupt controller */
+  bool INTR;
+
+  /* waiting at `hlt' for an interrupt */
+  bool halted;
+
 } CPU_state;
 
 extern CPU_state cpu;
@@ -2,6 +2,7 @@
 #define __RTL_H__
 
 #include "nemu.h"
+#include "monitor/monitor.h"
 
 extern rtlreg_t t0, t1, t2, t3;
 extern const rtlreg_t tzero;
@@ -61,10 +62,12 @@ static inline void rtl_idiv(rtlreg_t* q, rtlreg_t* r, const rtlreg_t* src1_hi, c
 
 static inline void rtl_lm(rtlreg_t *dest, const rtlreg_t* addr, int len) {
   *dest = vaddr_read(*addr, len);
+  nr_guest_load ++;
 }
 
 static inline void rtl_sm(rtlreg_t* addr, int len, const rtlreg_t* src1) {
   vaddr_write(*addr, len, *src1);
+  nr_guest_store ++;
 }
 
 static inline void rtl_lr_b(rtlreg_t* dest, int r) {
@@ -142,13 +145,15 @@ static inline void rtl_sext(rtlreg_t* dest, const rtlreg_t* src1, int width) {
 static inline void rtl_push(const rtlreg_t* src1) {
   // esp <- esp - 4
   // M[esp] <- src1
-  TODO();
+  rtl_subi(&reg_l(R_ESP), &reg_l(R_ESP), 4);
+  rtl_sm(&reg_l(R_ESP), 4, src1);
 }
 
 static inline void rtl_pop(rtlreg_t* dest) {
   // dest <- M[esp]
   // esp <- esp + 4
-  TODO();
+  rtl_lm(dest, &reg_l(R_ESP), 4);
+  rtl_addi(&reg_l(R_ESP), &reg_l(R_ESP), 4);
 }
 
 static inline void rtl_eq0(rtlreg_t* dest, const rtlreg_t* src1) {
@@ -26,6 +26,14 @@ extern FILE* log_fp;
         __FILE__, __LINE__, __func__, ## __VA_ARGS__); \
   } while (0)
 
+#ifdef LIBNEMU
+/* libnemu stops the instance running instead of aborting the process */
+void libnemu_fail(void) __attribute__((noreturn));
+#	define Assert_fail(cond) libnemu_fail()
+#else
+#	define Assert_fail(cond) assert(cond)
+#endif
+
 #define Assert(cond, ...) \
   do { \
     if (!(cond)) { \
@@ -33,7 +41,7 @@ extern FILE* log_fp;
       fprintf(stderr, "\33[1;31m"); \
       fprintf(stderr, __VA_ARGS__); \
       fprintf(stderr, "\33[0m\n"); \
-      assert(cond); \
+      Assert_fail(cond); \
     } \
   } while (0)
 
@@ -0,0 +1,21 @@
+#ifndef __DEVICE_H__
+#define __DEVICE_H__
+
+#include "common.h"
+
+/* Idle detection. A device register which the guest polls while waiting,
+ * such as the keyboard status, reports each read with device_poll(), and
+ * `is_empty' tells whether nothing new was found. device_idle() marks the
+ * guest idle directly, as `hlt' does.
+ */
+void device_poll(bool is_empty);
+void device_idle(void);
+
+/* The virtual time in guest instructions. It also counts the instructions
+ * skipped when an idle guest is fast-forwarded with the virtual clock.
+ */
+uint64_t vclock_instr(void);
+void vclock_skip(uint64_t);
+uint32_t vclock_get_mips(void);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef __DISPLAY_H__
+#define __DISPLAY_H__
+
+#include "common.h"
+
+#define SCREEN_H 300
+#define SCREEN_W 400
+
+/* A display backend shows the frames of the VGA. All of its functions
+ * are called by the display thread.
+ */
+typedef struct {
+  const char *name;
+  /* `arg' is the part after ':' of the `-s' option, or NULL */
+  void (*init)(const char *arg);
+  /* scanlines [y, y + h) of `pixels' have changed */
+  void (*update)(uint32_t (*pixels)[SCREEN_W], int y, int h);
+  /* all changes of a frame have been passed by update() */
+  void (*present)(void);
+  /* poll host input events, may be NULL */
+  void (*poll_event)(void);
+} DisplayBackend;
+
+/* input interface of the backends */
+void display_send_key(uint32_t, bool);
+void display_quit(void);
+
+#endif
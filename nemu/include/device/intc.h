@@ -0,0 +1,17 @@
+#ifndef __INTC_H__
+#define __INTC_H__
+
+#include "common.h"
+
+/* IRQ lines of the interrupt controller, a smaller number has a higher
+ * priority. The vector of line `n' is IRQ_VECTOR_BASE + n.
+ */
+enum { IRQ_TIMER, IRQ_KEYBOARD, IRQ_DISK, IRQ_VBLANK, NR_IRQ_LINE };
+
+#define IRQ_VECTOR_BASE 32
+
+void intc_raise(int);
+int intc_ack(void);
+void intc_stat(int, const char **, uint64_t *, uint64_t *);
+
+#endif
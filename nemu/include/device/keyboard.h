@@ -0,0 +1,33 @@
+#ifndef __KEYBOARD_H__
+#define __KEYBOARD_H__
+
+#include "common.h"
+
+/* the keys known by AM, in the order of their key codes */
+#define _KEYS(_) \
+  _(ESCAPE) _(F1) _(F2) _(F3) _(F4) _(F5) _(F6) _(F7) _(F8) _(F9) _(F10) _(F11) _(F12) \
+_(GRAVE) _(1) _(2) _(3) _(4) _(5) _(6) _(7) _(8) _(9) _(0) _(MINUS) _(EQUALS) _(BACKSPACE) \
+_(TAB) _(Q) _(W) _(E) _(R) _(T) _(Y) _(U) _(I) _(O) _(P) _(LEFTBRACKET) _(RIGHTBRACKET) _(BACKSLASH) \
+_(CAPSLOCK) _(A) _(S) _(D) _(F) _(G) _(H) _(J) _(K) _(L) _(SEMICOLON) _(APOSTROPHE) _(RETURN) \
+_(LSHIFT) _(Z) _(X) _(C) _(V) _(B) _(N) _(M) _(COMMA) _(PERIOD) _(SLASH) _(RSHIFT) \
+_(LCTRL) _(APPLICATION) _(LALT) _(SPACE) _(RALT) _(RCTRL) \
+_(UP) _(DOWN) _(LEFT) _(RIGHT) _(INSERT) _(DELETE) _(HOME) _(END) _(PAGEUP) _(PAGEDOWN)
+
+#define _KEY_NAME(k) _KEY_##k,
+
+enum {
+  _KEY_NONE = 0,
+  _KEYS(_KEY_NAME)
+};
+
+/* `am_key' is one of the _KEY_* codes above. This is the producer of
+ * the key queue. It is called by one thread only: the display thread, or
+ * the CPU thread for a key script.
+ */
+void send_key(uint32_t am_key, bool is_keydown);
+
+/* called by the CPU thread */
+void clear_key_queue(void);
+void i8042_update(void);
+
+#endif
@@ -5,10 +5,14 @@
 
 typedef void(*mmio_callback_t)(paddr_t, int, bool);
 
-void* add_mmio_map(paddr_t, int, mmio_callback_t);
+void* add_mmio_map(const char *, paddr_t, int, mmio_callback_t);
 int is_mmio(paddr_t);
 
 uint32_t mmio_read(paddr_t, int, int);
 void mmio_write(paddr_t, int, uint32_t, int);
 
+/* DMA interface for devices accessing the space of another device */
+void* mmio_to_host(paddr_t, uint32_t, int);
+void mmio_dma_written(paddr_t, int, int);
+
 #endif
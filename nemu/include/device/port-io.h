@@ -5,7 +5,7 @@
 
 typedef void(*pio_callback_t)(ioaddr_t, int, bool);
 
-void* add_pio_map(ioaddr_t, int, pio_callback_t);
+void* add_pio_map(const char *, ioaddr_t, int, pio_callback_t);
 
 uint32_t pio_read(ioaddr_t, int);
 void pio_write(ioaddr_t, int, uint32_t);
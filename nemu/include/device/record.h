@@ -0,0 +1,33 @@
+#ifndef __RECORD_H__
+#define __RECORD_H__
+
+#include "common.h"
+
+/* Record and replay of the nondeterministic inputs of devices. Each event
+ * is logged with the number of guest instructions executed when the CPU
+ * thread consumes it. Replaying the log feeds the same events to the
+ * guest at the same instructions, so the run is re-executed exactly.
+ */
+enum { REC_NONE, REC_RECORD, REC_REPLAY };
+
+enum {
+  REC_TICK,      /* a tick of the timer */
+  REC_RTC,       /* the RTC changes to `data' */
+  REC_TSC_MHZ,   /* the rate of the TSC changes to `data' */
+  REC_KEY,       /* the guest gets key `data' */
+  REC_KEY_IRQ,   /* the keyboard IRQ is raised */
+  REC_SERIAL,    /* byte `data' is received by the serial port */
+  REC_QUIT,      /* the user closes NEMU */
+  REC_END,       /* the recording stops */
+  NR_REC_TYPE
+};
+
+extern int rec_mode;
+
+void init_record(const char *file, bool is_replay);
+void rec_log(int type, uint32_t data);
+bool rec_replay(int type, uint32_t *data);
+uint32_t rec_value(int type, uint32_t val);
+uint64_t rec_next_instr(void);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __LIBNEMU_H__
+#define __LIBNEMU_H__
+
+/* libnemu, NEMU as a library. Build it with `make lib'.
+ *
+ * Each instance has its own registers, memory and devices. There is no
+ * monitor and no built-in device; the devices are callbacks given by the
+ * user. Instances may be used in turn from one thread, but not at the
+ * same time from several threads.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct NEMU NEMU;
+
+/* only the API is exported by libnemu.so */
+#define NEMU_API __attribute__((visibility("default")))
+
+/* registers for nemu_get_reg() and nemu_set_reg() */
+enum {
+  NEMU_REG_EAX, NEMU_REG_ECX, NEMU_REG_EDX, NEMU_REG_EBX,
+  NEMU_REG_ESP, NEMU_REG_EBP, NEMU_REG_ESI, NEMU_REG_EDI,
+  NEMU_REG_EIP
+};
+
+/* A device. `addr' is the port for PIO, or the physical address for MMIO.
+ * Either callback may be NULL, then reads return 0 and writes are ignored.
+ */
+typedef uint32_t (*nemu_io_read_t)(void *opaque, uint32_t addr, int len);
+typedef void (*nemu_io_write_t)(void *opaque, uint32_t addr, int len, uint32_t data);
+
+NEMU_API NEMU* nemu_create(void);
+NEMU_API void nemu_destroy(NEMU *nemu);
+
+/* Load the image at the entry of the guest, and reset the registers and
+ * the error. Return 0 on success, or -1 if the image is too large.
+ */
+NEMU_API int nemu_load(NEMU *nemu, const void *img, size_t size);
+
+/* Run at most `n' instructions. Return the number of instructions run.
+ * It stops earlier when the guest ends, see nemu_is_end(), when it
+ * executes `hlt', or on an error, see nemu_error().
+ */
+NEMU_API uint64_t nemu_run(NEMU *nemu, uint64_t n);
+
+/* Whether the guest has made NEMU fail, such as by an access out of the
+ * memory or an instruction not implemented. The message is printed to
+ * stderr. The instance does not run again until an image is loaded.
+ */
+NEMU_API int nemu_error(NEMU *nemu);
+
+/* Whether the guest has ended by `nemu_trap', the code is in EAX */
+NEMU_API int nemu_is_end(NEMU *nemu);
+NEMU_API uint64_t nemu_nr_instr(NEMU *nemu);
+
+NEMU_API uint32_t nemu_get_reg(NEMU *nemu, int reg);
+NEMU_API void nemu_set_reg(NEMU *nemu, int reg, uint32_t val);
+
+/* Access the physical memory. Return 0 on success, or -1 if the range
+ * is out of the memory. Devices are not accessed.
+ */
+NEMU_API int nemu_mem_read(NEMU *nemu, uint32_t addr, void *buf, size_t len);
+NEMU_API int nemu_mem_write(NEMU *nemu, uint32_t addr, const void *buf, size_t len);
+
+/* Add a device. Return 0 on success, or -1 if the range overlaps with
+ * another device.
+ */
+NEMU_API int nemu_add_pio(NEMU *nemu, uint16_t port, int len,
+    nemu_io_read_t read, nemu_io_write_t write, void *opaque);
+NEMU_API int nemu_add_mmio(NEMU *nemu, uint32_t addr, uint32_t len,
+    nemu_io_read_t read, nemu_io_write_t write, void *opaque);
+
+#endif
@@ -3,7 +3,10 @@
 
 #include "common.h"
 
-extern uint8_t pmem[];
+#define PMEM_SIZE (128 * 1024 * 1024)
+
+/* the memory of the machine, which is switched by libnemu between instances */
+extern uint8_t *pmem;
 
 /* convert the guest physical address in the guest program to host virtual address in NEMU */
 #define guest_to_host(p) ((void *)(pmem + (unsigned)p))
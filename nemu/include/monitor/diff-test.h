@@ -0,0 +1,41 @@
+#ifndef __DIFF_TEST_H__
+#define __DIFF_TEST_H__
+
+#include "common.h"
+#include <stddef.h>
+
+/* The register file exchanged with the reference. Its layout matches
+ * the beginning of the i386 `g' packet of the GDB remote protocol, so
+ * the QEMU backend can copy it directly.
+ */
+typedef struct {
+  uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+  uint32_t eip, eflags;
+} DiffRegs;
+
+enum { DIFFTEST_TO_DUT, DIFFTEST_TO_REF };
+
+/* The C ABI a reference model must export when it is loaded as a shared
+ * library with `-d ref.so'. NEMU is the DUT (design under test).
+ *
+ * void difftest_init(void);
+ *   Initialize the reference. It should run in 32-bit protected mode
+ *   with flat segments after this call.
+ * void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction);
+ *   Copy `n' bytes between the guest physical memory of the reference
+ *   at `addr' and `buf'.
+ * void difftest_regcpy(void *regs, bool direction);
+ *   Copy the register file, `regs' points to a `DiffRegs'.
+ * void difftest_exec(uint64_t n);
+ *   Execute `n' instructions.
+ */
+typedef void (*difftest_init_t)(void);
+typedef void (*difftest_memcpy_t)(paddr_t, void *, size_t, bool);
+typedef void (*difftest_regcpy_t)(void *, bool);
+typedef void (*difftest_exec_t)(uint64_t);
+
+void init_difftest(char *, char *);
+void difftest_memcpy_to_ref(paddr_t, void *, size_t);
+void init_ref_reg(void);
+
+#endif
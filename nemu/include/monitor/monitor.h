@@ -1,7 +1,26 @@
 #ifndef __MONITOR_H__
 #define __MONITOR_H__
 
+#include "common.h"
+
 enum { NEMU_STOP, NEMU_RUNNING, NEMU_END };
 extern int nemu_state;
 
+/* the number of guest instructions executed by cpu_exec() */
+extern uint64_t nr_guest_instr;
+/* memory accesses by instructions, and taken control transfers */
+extern uint64_t nr_guest_load, nr_guest_store, nr_guest_branch;
+
+/* cpu_exec() only serves the devices and interrupts when asked to, by an
+ * exit request or when nr_guest_instr reaches cpu_exit_instr. A request
+ * is served at the end of the current basic block. It may be made by a
+ * signal handler or another thread.
+ */
+extern volatile int cpu_exit_request;
+extern uint64_t cpu_exit_instr;
+
+static inline void cpu_request_exit() {
+  __atomic_store_n(&cpu_exit_request, 1, __ATOMIC_RELEASE);
+}
+
 #endif
@@ -0,0 +1,38 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include "common.h"
+#include <time.h>
+
+/* Counters of a PIO or MMIO map, shown in the report at exit */
+typedef struct {
+  const char *name;
+  uint64_t nr_read;
+  uint64_t nr_write;
+  uint64_t ns;        /* host time spent in the callback */
+} IOStat;
+
+/* host time spent in devices and sleeping for an idle guest */
+extern uint64_t perf_device_ns;
+extern uint64_t perf_idle_ns;
+
+/* whether there is a report at exit; the devices are only timed then */
+extern bool perf_is_on;
+
+static inline uint64_t get_host_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void init_perf(const char *json_file, bool is_print);
+void perf_exec_begin(void);
+void perf_exec_end(void);
+uint32_t perf_host_mips(void);
+
+int nr_pio_stat(void);
+const IOStat* pio_stat(int);
+int nr_mmio_stat(void);
+const IOStat* mmio_stat(int);
+
+#endif
@@ -1,12 +1,29 @@
 #!/bin/bash
 
+# Run the programs of cputest and each benchmark of microbench in batch
+# mode, in parallel on all host cores. For each of them, print whether it
+# passes, the guest instructions, the host time and the MIPS.
+#
+#   JOBS     the number of runs in parallel, the number of host cores by default
+#   INPUT    the input of microbench, TEST by default, REF for a longer run
+#   TIMEOUT  the seconds before a run is killed, 120 by default
+#   LOG=1    write the log of NEMU for each run, which is slow
+#   DIFF=1   build NEMU with differential testing against QEMU, and check
+#            each run with it, which is slow; cputest hlt takes timer
+#            interrupts. Run `make clean' when switching it.
+
 nemu=build/nemu
+out=build/regress
+jobs=${JOBS:-`nproc`}
+input=${INPUT:-TEST}
+timeout=${TIMEOUT:-120}
+benchs="qsort queen bf fib sieve 15pz dinic lzip ssort md5"
 
-if make &> /dev/null; then
+if make DIFF=$DIFF &> /dev/null; then
   echo "NEMU compile OK"
 else
-  echo "testcases compile error... exit..."
-  exit
+  echo "NEMU compile error... exit..."
+  exit 1
 fi
 
 echo "compiling testcases..."
@@ -14,26 +31,81 @@ if make -C $AM_HOME/tests/cputest ARCH=x86-nemu &> /dev/null; then
   echo "testcases compile OK"
 else
   echo "testcases compile error... exit..."
-  exit
+  exit 1
 fi
 
-files=`ls $AM_HOME/tests/cputest/build/*-x86-nemu.bin`
-ori_log="build/nemu-log.txt"
+echo "compiling microbench with INPUT=$input..."
+for b in $benchs; do
+  if ! make -C $AM_HOME/apps/microbench ARCH=x86-nemu INPUT=$input BENCH=$b &> /dev/null; then
+    echo "microbench compile error... exit..."
+    exit 1
+  fi
+done
+echo "microbench compile OK"
 
-for file in $files; do
-  base=`basename $file | sed -e 's/-x86-nemu.bin//'`
-  printf "[%14s] " $base
-  logfile=$base-log.txt
-  $nemu -b -l $ori_log $file &> $logfile
+rm -rf $out
+mkdir -p $out
 
-  if (grep 'nemu: HIT GOOD TRAP' $logfile > /dev/null) then
-    echo -e "\033[1;32mPASS!\033[0m"
-    rm $logfile
-  else
-    echo -e "\033[1;31mFAIL!\033[0m see $logfile for more information"
-    if (test -e $ori_log) then
-      echo -e "\n\n===== the original log.txt =====\n" >> $logfile
-      cat $ori_log >> $logfile
+# name and image of each run
+list=$out/list.txt
+for file in `ls $AM_HOME/tests/cputest/build/*-x86-nemu.bin`; do
+  echo `basename $file | sed -e 's/-x86-nemu.bin//'` $file
+done > $list
+for b in $benchs; do
+  echo microbench-$b $AM_HOME/apps/microbench/build/microbench-$b-x86-nemu.bin
+done >> $list
+
+function run() {
+  local args="-b -r $out/$1.json"
+  if [ "$LOG" == "1" ]; then
+    args="$args -l $out/$1-nemu-log.txt"
+  fi
+  timeout $timeout $nemu $args $2 &> $out/$1.txt
+}
+export -f run
+export nemu out timeout LOG
+
+echo "running `wc -l < $list` programs with $jobs jobs..."
+xargs -P $jobs -n 2 bash -c 'run "$@"' _ < $list
+
+# the value of `key' in the JSON report
+function json() {
+  sed -n -e "s/^ *\"$2\": \([0-9.]*\),*$/\1/p" $1
+}
+
+nr_fail=0
+printf "%-24s %-6s %14s %10s %10s\n" name result instructions "time(s)" MIPS
+while read name file; do
+  log=$out/$name.txt
+  report=$out/$name.json
+
+  pass=0
+  if grep 'nemu: HIT GOOD TRAP' $log > /dev/null; then
+    pass=1
+    if [[ $name == microbench-* ]] && ! grep 'MicroBench PASS' $log > /dev/null; then
+      pass=0
     fi
   fi
-done
+
+  if [ -e $report ]; then
+    instr=`json $report guest_instr`
+    secs=`awk "BEGIN { printf \"%.3f\", \`json $report wall_ns\` / 1e9 }"`
+    mips=`json $report mips`
+  else
+    instr=-; secs=-; mips=-
+  fi
+
+  if [ $pass == 1 ]; then
+    result="\033[1;32mPASS\033[0m  "
+    rm -f $log $out/$name-nemu-log.txt
+  else
+    result="\033[1;31mFAIL\033[0m  "
+    nr_fail=$((nr_fail + 1))
+  fi
+  printf "%-24s $result %14s %10s %10s\n" $name $instr $secs $mips
+done < $list
+
+if [ $nr_fail != 0 ]; then
+  echo -e "\033[1;31m$nr_fail failed\033[0m, see $out/ for their output"
+  exit 1
+fi
@@ -3,6 +3,9 @@
 
 /* shared by all helper functions */
 DecodeInfo decoding;
+#ifdef DEBUG
+DecodeAsm decoding_asm;
+#endif
 rtlreg_t t0, t1, t2, t3;
 const rtlreg_t tzero = 0;
 
@@ -18,7 +21,7 @@ static inline make_DopHelper(I) {
   rtl_li(&op->val, op->imm);
 
 #ifdef DEBUG
-  snprintf(op->str, OP_STR_SIZE, "$0x%x", op->imm);
+  op_sprintf(op, "$0x%x", op->imm);
 #endif
 }
 
@@ -43,7 +46,7 @@ static inline make_DopHelper(SI) {
   rtl_li(&op->val, op->simm);
 
 #ifdef DEBUG
-  snprintf(op->str, OP_STR_SIZE, "$0x%x", op->simm);
+  op_sprintf(op, "$0x%x", op->simm);
 #endif
 }
 
@@ -59,7 +62,7 @@ static inline make_DopHelper(a) {
   }
 
 #ifdef DEBUG
-  snprintf(op->str, OP_STR_SIZE, "%%%s", reg_name(R_EAX, op->width));
+  op_sprintf(op, "%%%s", reg_name(R_EAX, op->width));
 #endif
 }
 
@@ -75,7 +78,7 @@ static inline make_DopHelper(r) {
   }
 
 #ifdef DEBUG
-  snprintf(op->str, OP_STR_SIZE, "%%%s", reg_name(op->reg, op->width));
+  op_sprintf(op, "%%%s", reg_name(op->reg, op->width));
 #endif
 }
 
@@ -102,7 +105,7 @@ static inline make_DopHelper(O) {
   }
 
 #ifdef DEBUG
-  snprintf(op->str, OP_STR_SIZE, "0x%x", op->addr);
+  op_sprintf(op, "0x%x", op->addr);
 #endif
 }
 
@@ -222,7 +225,7 @@ make_DHelper(gp2_1_E) {
   id_src->imm = 1;
   rtl_li(&id_src->val, 1);
 #ifdef DEBUG
-  sprintf(id_src->str, "$1");
+  op_sprintf(id_src, "$1");
 #endif
 }
 
@@ -232,7 +235,7 @@ make_DHelper(gp2_cl2E) {
   id_src->reg = R_CL;
   rtl_lr_b(&id_src->val, R_CL);
 #ifdef DEBUG
-  sprintf(id_src->str, "%%cl");
+  op_sprintf(id_src, "%%cl");
 #endif
 }
 
@@ -281,7 +284,7 @@ make_DHelper(in_dx2a) {
   id_src->reg = R_DX;
   rtl_lr_w(&id_src->val, R_DX);
 #ifdef DEBUG
-  sprintf(id_src->str, "(%%dx)");
+  op_sprintf(id_src, "(%%dx)");
 #endif
 
   decode_op_a(eip, id_dest, false);
@@ -300,7 +303,7 @@ make_DHelper(out_a2dx) {
   id_dest->reg = R_DX;
   rtl_lr_w(&id_dest->val, R_DX);
 #ifdef DEBUG
-  sprintf(id_dest->str, "(%%dx)");
+  op_sprintf(id_dest, "(%%dx)");
 #endif
 }
 
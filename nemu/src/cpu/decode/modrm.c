@@ -46,31 +46,33 @@ void load_addr(vaddr_t *eip, ModR_M *m, Operand *rm) {
   }
 
 #ifdef DEBUG
-  char disp_buf[16];
-  char base_buf[8];
-  char index_buf[8];
-
-  if (disp_size != 0) {
-    /* has disp */
-    sprintf(disp_buf, "%s%#x", (disp < 0 ? "-" : ""), (disp < 0 ? -disp : disp));
-  }
-  else { disp_buf[0] = '\0'; }
+  if (decoding_asm.is_on) {
+    char disp_buf[16];
+    char base_buf[8];
+    char index_buf[8];
+
+    if (disp_size != 0) {
+      /* has disp */
+      sprintf(disp_buf, "%s%#x", (disp < 0 ? "-" : ""), (disp < 0 ? -disp : disp));
+    }
+    else { disp_buf[0] = '\0'; }
 
-  if (base_reg == -1) { base_buf[0] = '\0'; }
-  else { 
-    sprintf(base_buf, "%%%s", reg_name(base_reg, 4));
-  }
+    if (base_reg == -1) { base_buf[0] = '\0'; }
+    else {
+      sprintf(base_buf, "%%%s", reg_name(base_reg, 4));
+    }
 
-  if (index_reg == -1) { index_buf[0] = '\0'; }
-  else { 
-    sprintf(index_buf, ",%%%s,%d", reg_name(index_reg, 4), 1 << scale);
-  }
+    if (index_reg == -1) { index_buf[0] = '\0'; }
+    else {
+      sprintf(index_buf, ",%%%s,%d", reg_name(index_reg, 4), 1 << scale);
+    }
 
-  if (base_reg == -1 && index_reg == -1) {
-    sprintf(rm->str, "%s", disp_buf);
-  }
-  else {
-    sprintf(rm->str, "%s(%s%s)", disp_buf, base_buf, index_buf);
+    if (base_reg == -1 && index_reg == -1) {
+      op_sprintf(rm, "%s", disp_buf);
+    }
+    else {
+      op_sprintf(rm, "%s(%s%s)", disp_buf, base_buf, index_buf);
+    }
   }
 #endif
 
@@ -89,7 +91,7 @@ void read_ModR_M(vaddr_t *eip, Operand *rm, bool load_rm_val, Operand *reg, bool
     }
 
 #ifdef DEBUG
-    snprintf(reg->str, OP_STR_SIZE, "%%%s", reg_name(reg->reg, reg->width));
+    op_sprintf(reg, "%%%s", reg_name(reg->reg, reg->width));
 #endif
   }
 
@@ -101,7 +103,7 @@ void read_ModR_M(vaddr_t *eip, Operand *rm, bool load_rm_val, Operand *reg, bool
     }
 
 #ifdef DEBUG
-    sprintf(rm->str, "%%%s", reg_name(m.R_M, rm->width));
+    op_sprintf(rm, "%%%s", reg_name(m.R_M, rm->width));
 #endif
   }
   else {
@@ -6,3 +6,9 @@ make_EHelper(operand_size);
 
 make_EHelper(inv);
 make_EHelper(nemu_trap);
+make_EHelper(hlt);
+make_EHelper(rdtsc);
+make_EHelper(lidt);
+make_EHelper(iret);
+make_EHelper(cli);
+make_EHelper(sti);
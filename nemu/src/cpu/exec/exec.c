@@ -1,18 +1,6 @@
 #include "cpu/exec.h"
 #include "all-instr.h"
 
-typedef struct {
-  DHelper decode;
-  EHelper execute;
-  int width;
-} opcode_entry;
-
-#define IDEXW(id, ex, w)   {concat(decode_, id), concat(exec_, ex), w}
-#define IDEX(id, ex)       IDEXW(id, ex, 0)
-#define EXW(ex, w)         {NULL, concat(exec_, ex), w}
-#define EX(ex)             EXW(ex, 0)
-#define EMPTY              EX(inv)
-
 static inline void set_width(int width) {
   if (width == 0) {
     width = decoding.is_operand_size_16 ? 2 : 4;
@@ -20,229 +8,137 @@ static inline void set_width(int width) {
   decoding.src.width = decoding.dest.width = decoding.src2.width = width;
 }
 
-/* Instruction Decode and EXecute */
-static inline void idex(vaddr_t *eip, opcode_entry *e) {
-  /* eip is pointing to the byte next to opcode */
-  if (e->decode)
-    e->decode(eip);
-  e->execute(eip);
-}
-
 static make_EHelper(2byte_esc);
 
-#define make_group(name, item0, item1, item2, item3, item4, item5, item6, item7) \
-  static opcode_entry concat(opcode_table_, name) [8] = { \
-    /* 0x00 */	item0, item1, item2, item3, \
-    /* 0x04 */	item4, item5, item6, item7  \
+/* The decoder is generated from the specification in opcode-table.h.
+ * Each opcode gets its own function which sets the width and calls the
+ * decode and execute helpers directly, so a fixed width is a constant.
+ */
+
+#define IDEX(op, id, ex)   IDEXW(op, id, ex, 0)
+#define EX(op, ex)         EXW(op, ex, 0)
+
+/* the items of the groups */
+#define GROUP_BEGIN(name)
+#define GROUP_END(name)
+#define GP_IDEX(name, idx, id, ex) \
+  static make_EHelper(concat3(name, _, idx)) { \
+    concat(decode_, id) (eip); \
+    concat(exec_, ex) (eip); \
+  }
+#define GP_EX(name, idx, ex) \
+  static make_EHelper(concat3(name, _, idx)) { \
+    concat(exec_, ex) (eip); \
+  }
+#define IDEXW(op, id, ex, w)
+#define EXW(op, ex, w)
+#include "opcode-table.h"
+#undef GROUP_BEGIN
+#undef GROUP_END
+#undef GP_IDEX
+#undef GP_EX
+#undef IDEXW
+#undef EXW
+
+/* the groups, selected by the reg field of ModR/M */
+#define GROUP_BEGIN(name) \
+  static EHelper concat(group_, name) [8] = { \
+    [0 ... 7] = exec_inv,
+#define GROUP_END(name) \
   }; \
-static make_EHelper(name) { \
-  idex(eip, &concat(opcode_table_, name)[decoding.ext_opcode]); \
-}
-
-/* 0x80, 0x81, 0x83 */
-make_group(gp1,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
-
-  /* 0xc0, 0xc1, 0xd0, 0xd1, 0xd2, 0xd3 */
-make_group(gp2,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
-
-  /* 0xf6, 0xf7 */
-make_group(gp3,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
-
-  /* 0xfe */
-make_group(gp4,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
-
-  /* 0xff */
-make_group(gp5,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
-
-  /* 0x0f 0x01*/
-make_group(gp7,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
-
-/* TODO: Add more instructions!!! */
-
-opcode_entry opcode_table [512] = {
-  /* 0x00 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x04 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x08 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x0c */	EMPTY, EMPTY, EMPTY, EX(2byte_esc),
-  /* 0x10 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x14 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x18 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x1c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x20 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x24 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x28 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x2c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x30 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x34 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x38 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x3c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x40 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x44 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x48 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x4c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x50 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x54 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x58 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x5c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x60 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x64 */	EMPTY, EMPTY, EX(operand_size), EMPTY,
-  /* 0x68 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x6c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x70 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x74 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x78 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x7c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x80 */	IDEXW(I2E, gp1, 1), IDEX(I2E, gp1), EMPTY, IDEX(SI2E, gp1),
-  /* 0x84 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x88 */	IDEXW(mov_G2E, mov, 1), IDEX(mov_G2E, mov), IDEXW(mov_E2G, mov, 1), IDEX(mov_E2G, mov),
-  /* 0x8c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x90 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x94 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x98 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x9c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa0 */	IDEXW(O2a, mov, 1), IDEX(O2a, mov), IDEXW(a2O, mov, 1), IDEX(a2O, mov),
-  /* 0xa4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xac */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xb0 */	IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1),
-  /* 0xb4 */	IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1),
-  /* 0xb8 */	IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov),
-  /* 0xbc */	IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov),
-  /* 0xc0 */	IDEXW(gp2_Ib2E, gp2, 1), IDEX(gp2_Ib2E, gp2), EMPTY, EMPTY,
-  /* 0xc4 */	EMPTY, EMPTY, IDEXW(mov_I2E, mov, 1), IDEX(mov_I2E, mov),
-  /* 0xc8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xcc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xd0 */	IDEXW(gp2_1_E, gp2, 1), IDEX(gp2_1_E, gp2), IDEXW(gp2_cl2E, gp2, 1), IDEX(gp2_cl2E, gp2),
-  /* 0xd4 */	EMPTY, EMPTY, EX(nemu_trap), EMPTY,
-  /* 0xd8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xdc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xec */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf4 */	EMPTY, EMPTY, IDEXW(E, gp3, 1), IDEX(E, gp3),
-  /* 0xf8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xfc */	EMPTY, EMPTY, IDEXW(E, gp4, 1), IDEX(E, gp5),
+  static make_EHelper(name) { \
+    concat(group_, name) [decoding.ext_opcode] (eip); \
+  }
+#define GP_IDEX(name, idx, id, ex) [idx] = concat4(exec_, name, _, idx),
+#define GP_EX(name, idx, ex)       [idx] = concat4(exec_, name, _, idx),
+#define IDEXW(op, id, ex, w)
+#define EXW(op, ex, w)
+#include "opcode-table.h"
+#undef GROUP_BEGIN
+#undef GROUP_END
+#undef GP_IDEX
+#undef GP_EX
+#undef IDEXW
+#undef EXW
+
+/* the opcodes */
+#define GROUP_BEGIN(name)
+#define GROUP_END(name)
+#define GP_IDEX(name, idx, id, ex)
+#define GP_EX(name, idx, ex)
+#define IDEXW(op, id, ex, w) \
+  static make_EHelper(concat(op_, op)) { \
+    set_width(w); \
+    concat(decode_, id) (eip); \
+    concat(exec_, ex) (eip); \
+  }
+#define EXW(op, ex, w) \
+  static make_EHelper(concat(op_, op)) { \
+    set_width(w); \
+    concat(exec_, ex) (eip); \
+  }
+#include "opcode-table.h"
+#undef IDEXW
+#undef EXW
 
-  /*2 byte_opcode_table */
+#define IDEXW(op, id, ex, w) [op] = concat(exec_op_, op),
+#define EXW(op, ex, w)       [op] = concat(exec_op_, op),
 
-  /* 0x00 */	EMPTY, IDEX(gp7_E, gp7), EMPTY, EMPTY,
-  /* 0x04 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x08 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x0c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x10 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x14 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x18 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x1c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x20 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x24 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x28 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x2c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x30 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x34 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x38 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x3c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x40 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x44 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x48 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x4c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x50 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x54 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x58 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x5c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x60 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x64 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x68 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x6c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x70 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x74 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x78 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x7c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x80 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x84 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x88 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x8c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x90 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x94 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x98 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x9c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xac */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xb0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xb4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xb8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xbc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xc0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xc4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xc8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xcc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xd0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xd4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xd8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xdc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xec */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xfc */	EMPTY, EMPTY, EMPTY, EMPTY
+EHelper opcode_table [512] = {
+  [0 ... 511] = exec_inv,
+#include "opcode-table.h"
 };
 
+#undef GROUP_BEGIN
+#undef GROUP_END
+#undef GP_IDEX
+#undef GP_EX
+#undef IDEXW
+#undef EXW
+#undef IDEX
+#undef EX
+
 static make_EHelper(2byte_esc) {
   uint32_t opcode = instr_fetch(eip, 1) | 0x100;
   decoding.opcode = opcode;
-  set_width(opcode_table[opcode].width);
-  idex(eip, &opcode_table[opcode]);
+  opcode_table[opcode](eip);
 }
 
 make_EHelper(real) {
   uint32_t opcode = instr_fetch(eip, 1);
   decoding.opcode = opcode;
-  set_width(opcode_table[opcode].width);
-  idex(eip, &opcode_table[opcode]);
+  opcode_table[opcode](eip);
 }
 
 static inline void update_eip(void) {
+  if (decoding.is_jmp) { nr_guest_branch ++; }
   cpu.eip = (decoding.is_jmp ? (decoding.is_jmp = 0, decoding.jmp_eip) : decoding.seq_eip);
 }
 
 void exec_wrapper(bool print_flag) {
 #ifdef DEBUG
-  decoding.p = decoding.asm_buf;
-  decoding.p += sprintf(decoding.p, "%8x:   ", cpu.eip);
+  decoding_asm.is_on = (print_flag || log_fp != NULL);
+  if (decoding_asm.is_on) {
+    decoding_asm.p = decoding_asm.asm_buf;
+    decoding_asm.p += sprintf(decoding_asm.p, "%8x:   ", cpu.eip);
+  }
 #endif
 
   decoding.seq_eip = cpu.eip;
   exec_real(&decoding.seq_eip);
 
 #ifdef DEBUG
-  int instr_len = decoding.seq_eip - cpu.eip;
-  sprintf(decoding.p, "%*.s", 50 - (12 + 3 * instr_len), "");
-  char strbuf[512];
-  strcpy(strbuf, decoding.asm_buf);
-  // strcat(decoding.asm_buf, decoding.assembly);
-  strcat(strbuf, decoding.assembly);
-  strcpy(decoding.asm_buf, strbuf);
-  Log_write("%s\n", decoding.asm_buf);
-  if (print_flag) {
-    puts(decoding.asm_buf);
+  if (decoding_asm.is_on) {
+    int instr_len = decoding.seq_eip - cpu.eip;
+    sprintf(decoding_asm.p, "%*.s", 50 - (12 + 3 * instr_len), "");
+    char strbuf[512];
+    strcpy(strbuf, decoding_asm.asm_buf);
+    strcat(strbuf, decoding_asm.assembly);
+    strcpy(decoding_asm.asm_buf, strbuf);
+    Log_write("%s\n", decoding_asm.asm_buf);
+    if (print_flag) {
+      puts(decoding_asm.asm_buf);
+    }
   }
 #endif
 
@@ -50,7 +50,7 @@ make_EHelper(setcc) {
   rtl_setcc(&t2, subcode);
   operand_write(id_dest, &t2);
 
-  print_asm("set%s %s", get_cc_name(subcode), id_dest->str);
+  print_asm("set%s %s", get_cc_name(subcode), op_str(id_dest));
 }
 
 make_EHelper(not) {
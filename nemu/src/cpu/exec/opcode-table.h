@@ -0,0 +1,101 @@
+/* The specification of the instructions, one line per opcode. exec.c
+ * expands it several times, so there is no include guard.
+ *
+ *   IDEXW(opcode, decode, execute, width)
+ *   IDEX(opcode, decode, execute)    the width is given by the operand-size prefix
+ *   EXW(opcode, execute, width)
+ *   EX(opcode, execute)
+ *
+ * Two-byte opcodes `0x0f xx' are written as 0x1xx. The items of a ModR/M
+ * group are given between GROUP_BEGIN() and GROUP_END() with GP_IDEX() and
+ * GP_EX(), indexed by the reg field of ModR/M. They are executed with the
+ * width of the opcode using the group. Opcodes not listed are invalid, and
+ * an opcode listed twice is a compile error.
+ */
+
+/* 0x80, 0x81, 0x83 */
+GROUP_BEGIN(gp1)
+GROUP_END(gp1)
+
+/* 0xc0, 0xc1, 0xd0, 0xd1, 0xd2, 0xd3 */
+GROUP_BEGIN(gp2)
+GROUP_END(gp2)
+
+/* 0xf6, 0xf7 */
+GROUP_BEGIN(gp3)
+GROUP_END(gp3)
+
+/* 0xfe */
+GROUP_BEGIN(gp4)
+GROUP_END(gp4)
+
+/* 0xff */
+GROUP_BEGIN(gp5)
+GROUP_END(gp5)
+
+/* 0x0f 0x01*/
+GROUP_BEGIN(gp7)
+GP_EX(gp7, 3, lidt)
+GROUP_END(gp7)
+
+/* TODO: Add more instructions!!! */
+
+EX(0x0f, 2byte_esc)
+
+EX(0x66, operand_size)
+
+IDEXW(0x80, I2E, gp1, 1)
+IDEX(0x81, I2E, gp1)
+IDEX(0x83, SI2E, gp1)
+
+IDEXW(0x88, mov_G2E, mov, 1)
+IDEX(0x89, mov_G2E, mov)
+IDEXW(0x8a, mov_E2G, mov, 1)
+IDEX(0x8b, mov_E2G, mov)
+
+IDEXW(0xa0, O2a, mov, 1)
+IDEX(0xa1, O2a, mov)
+IDEXW(0xa2, a2O, mov, 1)
+IDEX(0xa3, a2O, mov)
+
+IDEXW(0xb0, mov_I2r, mov, 1)
+IDEXW(0xb1, mov_I2r, mov, 1)
+IDEXW(0xb2, mov_I2r, mov, 1)
+IDEXW(0xb3, mov_I2r, mov, 1)
+IDEXW(0xb4, mov_I2r, mov, 1)
+IDEXW(0xb5, mov_I2r, mov, 1)
+IDEXW(0xb6, mov_I2r, mov, 1)
+IDEXW(0xb7, mov_I2r, mov, 1)
+IDEX(0xb8, mov_I2r, mov)
+IDEX(0xb9, mov_I2r, mov)
+IDEX(0xba, mov_I2r, mov)
+IDEX(0xbb, mov_I2r, mov)
+IDEX(0xbc, mov_I2r, mov)
+IDEX(0xbd, mov_I2r, mov)
+IDEX(0xbe, mov_I2r, mov)
+IDEX(0xbf, mov_I2r, mov)
+
+IDEXW(0xc0, gp2_Ib2E, gp2, 1)
+IDEX(0xc1, gp2_Ib2E, gp2)
+IDEXW(0xc6, mov_I2E, mov, 1)
+IDEX(0xc7, mov_I2E, mov)
+EX(0xcf, iret)
+
+IDEXW(0xd0, gp2_1_E, gp2, 1)
+IDEX(0xd1, gp2_1_E, gp2)
+IDEXW(0xd2, gp2_cl2E, gp2, 1)
+IDEX(0xd3, gp2_cl2E, gp2)
+EX(0xd6, nemu_trap)
+
+EX(0xf4, hlt)
+IDEXW(0xf6, E, gp3, 1)
+IDEX(0xf7, E, gp3)
+EX(0xfa, cli)
+EX(0xfb, sti)
+IDEXW(0xfe, E, gp4, 1)
+IDEX(0xff, E, gp5)
+
+/* 2 byte opcodes */
+
+IDEX(0x101, gp7_E, gp7)
+EX(0x131, rdtsc)
@@ -27,6 +27,11 @@ make_EHelper(inv) {
       "* The machine is always right!\n"
       "* Every line of untested code is always wrong!\33[0m\n\n", logo);
 
+#ifdef LIBNEMU
+  /* an error of the instance, see nemu_error() */
+  libnemu_fail();
+#endif
+
   nemu_state = NEMU_END;
 
   print_asm("invalid opcode");
@@ -1,10 +1,16 @@
 #include "cpu/exec.h"
+#include "device/device.h"
 
 void diff_test_skip_qemu();
 void diff_test_skip_nemu();
 
 make_EHelper(lidt) {
-  TODO();
+  /* a 16-bit limit followed by a 32-bit base */
+  rtl_lm(&t0, &id_dest->addr, 2);
+  cpu.idtr.limit = t0;
+  rtl_addi(&t1, &id_dest->addr, 2);
+  rtl_lm(&t0, &t1, 4);
+  cpu.idtr.base = t0;
 
   print_asm_template1(lidt);
 }
@@ -28,15 +34,28 @@ make_EHelper(mov_cr2r) {
 make_EHelper(int) {
   TODO();
 
-  print_asm("int %s", id_dest->str);
+  print_asm("int %s", op_str(id_dest));
 
 #ifdef DIFF_TEST
   diff_test_skip_nemu();
 #endif
 }
 
+/* an interrupt masked by IF is taken once IF is set */
+static inline void check_unmasked_intr() {
+  if (cpu.eflags.IF && cpu.INTR) {
+    cpu_request_exit();
+  }
+}
+
 make_EHelper(iret) {
-  TODO();
+  rtl_pop(&decoding.jmp_eip);
+  decoding.is_jmp = 1;
+  rtl_pop(&t0);
+  cpu.cs = t0;
+  rtl_pop(&t0);
+  cpu.eflags.val = t0;
+  check_unmasked_intr();
 
   print_asm("iret");
 }
@@ -63,3 +82,51 @@ make_EHelper(out) {
   diff_test_skip_qemu();
 #endif
 }
+
+/* The TSC counts guest instructions as cycles, see vclock_instr(). */
+make_EHelper(rdtsc) {
+  uint64_t tsc = vclock_instr();
+  rtl_li(&t0, tsc);
+  rtl_sr_l(R_EAX, &t0);
+  rtl_li(&t0, tsc >> 32);
+  rtl_sr_l(R_EDX, &t0);
+
+  print_asm("rdtsc");
+
+#ifdef DIFF_TEST
+  diff_test_skip_qemu();
+#endif
+}
+
+make_EHelper(cli) {
+  cpu.eflags.IF = 0;
+
+  print_asm("cli");
+}
+
+make_EHelper(sti) {
+  cpu.eflags.IF = 1;
+  check_unmasked_intr();
+
+  print_asm("sti");
+}
+
+make_EHelper(hlt) {
+  if (!(cpu.INTR && cpu.eflags.IF)) {
+    /* stay at `hlt' until an interrupt comes, and let the host sleep.
+     * The interrupt returns to the next instruction, see check_intr(). */
+    decoding.jmp_eip = cpu.eip;
+    decoding.is_jmp = 1;
+    cpu.halted = true;
+    device_idle();
+  }
+  else {
+    cpu.halted = false;
+  }
+
+  print_asm("hlt");
+
+#ifdef DIFF_TEST
+  diff_test_skip_qemu();
+#endif
+}
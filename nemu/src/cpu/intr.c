@@ -1,13 +1,67 @@
 #include "cpu/exec.h"
 #include "memory/mmu.h"
+#include "device/intc.h"
 
+#define STS_IG32 0xe   /* the type of a 32-bit interrupt gate */
+
+/* Trigger the interrupt or exception `NO'. The handler is entered as the
+ * next instruction, and it returns to `ret_addr' with `iret'.
+ */
 void raise_intr(uint8_t NO, vaddr_t ret_addr) {
-  /* TODO: Trigger an interrupt/exception with ``NO''.
-   * That is, use ``NO'' to index the IDT.
-   */
+  Assert(NO * 8 + 7 <= cpu.idtr.limit, "vector %d is beyond the IDT", NO);
+  GateDesc gate;
+  vaddr_t gate_addr = cpu.idtr.base + NO * 8;
+  gate.val = vaddr_read(gate_addr, 4);
+  uint32_t high = vaddr_read(gate_addr + 4, 4);
+  Assert(high & 0x8000, "the gate of vector %d is not present", NO);
+
+  rtl_li(&t0, cpu.eflags.val);
+  rtl_push(&t0);
+  rtl_li(&t0, cpu.cs);
+  rtl_push(&t0);
+  rtl_li(&t0, ret_addr);
+  rtl_push(&t0);
 
-  TODO();
+  /* an interrupt gate masks interrupts in the handler, a trap gate does not */
+  if (((high >> 8) & 0xf) == STS_IG32) {
+    cpu.eflags.IF = 0;
+  }
+
+  decoding.jmp_eip = (high & 0xffff0000) | gate.offset_15_0;
+  decoding.is_jmp = 1;
 }
 
 void dev_raise_intr() {
+  cpu.INTR = true;
+  cpu_request_exit();
+}
+
+/* Called by cpu_exec() at the end of a basic block when the INTR pin is
+ * set. The pin stays set until the interrupt is taken, and cpu_exec()
+ * calls this again at the end of each basic block until then, as long
+ * as IF is set.
+ */
+void check_intr() {
+  /* masked, the pin stays set until `iret' or `sti' sets IF */
+  if (!cpu.eflags.IF) {
+    return;
+  }
+
+  cpu.INTR = false;
+  int irq = intc_ack();
+  if (irq != -1) {
+    /* a halted CPU is at `hlt', which is the last instruction executed */
+    vaddr_t ret_addr = (cpu.halted ? decoding.seq_eip : cpu.eip);
+    cpu.halted = false;
+    raise_intr(IRQ_VECTOR_BASE + irq, ret_addr);
+    /* between two instructions, so enter the handler now */
+    cpu.eip = decoding.jmp_eip;
+    decoding.is_jmp = 0;
+
+#ifdef DIFF_TEST
+    /* the reference does not see the interrupt, copy the state to it at the next instruction */
+    void diff_test_skip_qemu();
+    diff_test_skip_qemu();
+#endif
+  }
 }
@@ -0,0 +1,141 @@
+#include "nemu.h"
+
+#ifdef HAS_IOE
+
+#include "device/mmio.h"
+#include "device/device.h"
+
+/* A 2D blitter. It operates on rectangles of 32-bit pixels, which may
+ * be in the guest memory or in the space of another device, such as the
+ * VGA memory. The guest sets up the registers, then writes BLIT_CMD_START
+ * into CMD. The operation is finished when the write to CMD returns.
+ *
+ *   COPY   dst = src
+ *   FILL   dst = COLOR, SRC is not used
+ *   BLEND  dst = src, except the pixels of src equal to COLOR (color key)
+ */
+#define BLIT_MMIO 0xc1000
+
+#define BLIT_REG_OP        0x00
+#define BLIT_REG_SRC       0x04   /* physical address of the top left pixel */
+#define BLIT_REG_SRC_PITCH 0x08   /* pixels per row */
+#define BLIT_REG_DST       0x0c
+#define BLIT_REG_DST_PITCH 0x10
+#define BLIT_REG_W         0x14
+#define BLIT_REG_H         0x18
+#define BLIT_REG_COLOR     0x1c
+#define BLIT_REG_CMD       0x20
+#define BLIT_REG_STATUS    0x24   /* BLIT_STATUS_* of the last operation */
+#define BLIT_REG_END       0x28
+
+#define BLIT_OP_COPY  0
+#define BLIT_OP_FILL  1
+#define BLIT_OP_BLEND 2
+
+#define BLIT_CMD_START 1
+
+#define BLIT_STATUS_OK    0
+#define BLIT_STATUS_ERROR 1
+
+#define reg(r) blit_base[concat(BLIT_REG_, r) / 4]
+
+static uint32_t *blit_base;
+
+/* The host address of a row of `len' bytes at `addr'. `map_NO' is set
+ * to the MMIO map of the row, or -1 if it is in the guest memory.
+ */
+static uint32_t* row_to_host(paddr_t addr, uint32_t len, int *map_NO) {
+  *map_NO = is_mmio(addr);
+  if (*map_NO != -1) {
+    return mmio_to_host(addr, len, *map_NO);
+  }
+  if (addr >= PMEM_SIZE || len > PMEM_SIZE - addr) {
+    return NULL;
+  }
+  return guest_to_host(addr);
+}
+
+static uint32_t blit_row(uint32_t op, paddr_t src, paddr_t dst, uint32_t w) {
+  uint32_t len = w * sizeof(uint32_t);
+  int src_map_NO, dst_map_NO;
+  uint32_t *d = row_to_host(dst, len, &dst_map_NO);
+  uint32_t *s = (op == BLIT_OP_FILL ? NULL : row_to_host(src, len, &src_map_NO));
+  if (d == NULL || (op != BLIT_OP_FILL && s == NULL)) {
+    return BLIT_STATUS_ERROR;
+  }
+
+#ifdef DIFF_TEST
+  if (dst_map_NO == -1) {
+    /* the reference does not have the blitter */
+    void difftest_log_dma(paddr_t, size_t);
+    difftest_log_dma(dst, len);
+  }
+#endif
+
+  uint32_t color = reg(COLOR);
+  uint32_t i;
+  switch (op) {
+    case BLIT_OP_COPY: memmove(d, s, len); break;
+    case BLIT_OP_FILL: for (i = 0; i < w; i ++) { d[i] = color; } break;
+    case BLIT_OP_BLEND:
+      for (i = 0; i < w; i ++) {
+        if (s[i] != color) { d[i] = s[i]; }
+      }
+      break;
+    default: return BLIT_STATUS_ERROR;
+  }
+
+  if (dst_map_NO != -1) {
+    mmio_dma_written(dst, len, dst_map_NO);
+  }
+  return BLIT_STATUS_OK;
+}
+
+static uint32_t blit_start() {
+  uint32_t op = reg(OP), w = reg(W), h = reg(H);
+  paddr_t src = reg(SRC), dst = reg(DST);
+  uint32_t src_pitch = reg(SRC_PITCH) * sizeof(uint32_t);
+  uint32_t dst_pitch = reg(DST_PITCH) * sizeof(uint32_t);
+  if (w == 0 || h == 0) {
+    return BLIT_STATUS_OK;
+  }
+  /* the length of a row in bytes should not wrap */
+  if (w > UINT32_MAX / sizeof(uint32_t)) {
+    return BLIT_STATUS_ERROR;
+  }
+
+  /* copy from the bottom row if dst is below src, in case they overlap */
+  int y = 0, dy = 1;
+  if (op != BLIT_OP_FILL && dst > src) {
+    y = h - 1;
+    dy = -1;
+  }
+
+  uint32_t n;
+  for (n = 0; n < h; n ++, y += dy) {
+    uint32_t ret = blit_row(op, src + y * src_pitch, dst + y * dst_pitch, w);
+    if (ret != BLIT_STATUS_OK) {
+      return ret;
+    }
+  }
+  return BLIT_STATUS_OK;
+}
+
+void blit_io_handler(paddr_t addr, int len, bool is_write) {
+  if (is_write && addr - BLIT_MMIO == BLIT_REG_CMD) {
+    if (reg(CMD) == BLIT_CMD_START) {
+      reg(STATUS) = blit_start();
+      device_poll(false);
+#ifdef DIFF_TEST
+      void diff_test_skip_qemu();
+      diff_test_skip_qemu();
+#endif
+    }
+  }
+}
+
+void init_blitter() {
+  blit_base = add_mmio_map("blitter", BLIT_MMIO, BLIT_REG_END, blit_io_handler);
+}
+
+#endif	/* HAS_IOE */
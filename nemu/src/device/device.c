@@ -2,29 +2,85 @@
 
 #ifdef HAS_IOE
 
-#include <sys/time.h>
+#include <sys/syscall.h>
 #include <signal.h>
-#include <SDL2/SDL.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "device/device.h"
+#include "device/record.h"
+#include "device/display.h"
+#include "device/keyboard.h"
+#include "device/intc.h"
+#include "monitor/monitor.h"
+#include "monitor/perf.h"
 
 #define TIMER_HZ 100
 #define VGA_HZ 50
 
+/* the rate of the virtual clock for a key script if it is not given */
+#define KEY_SCRIPT_MIPS "100"
+
+/* the signal of the host timer, readline does not catch it */
+#define TIMER_SIG SIGRTMIN
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 static uint64_t jiffy = 0;
-static struct itimerval it;
+static timer_t host_timer;
+/* the number of guest instructions between two ticks of the virtual clock,
+ * 0 means the timer is driven by the host */
+static uint64_t vclock_period = 0;
+static uint64_t vclock_next_tick = 0;
+static volatile sig_atomic_t is_tick_pending = false;
 static int device_update_flag = false;
 static int update_screen_flag = false;
 
-void init_serial();
+void init_intc();
+void init_serial(const char *);
 void init_timer();
 void init_vga();
 void init_i8042();
+void init_disk(const char *);
+void init_blitter();
+void init_perfcnt();
 
 extern void timer_intr();
-extern void send_key(uint8_t, bool);
+extern void serial_update();
+extern void init_vclock(uint32_t);
 extern void update_screen();
+extern void present_screen(DisplayBackend *);
+extern void init_key_script(const char *);
+extern void poll_key_script();
 
+extern DisplayBackend none_display, ppm_display, yuv_display, shm_display;
+#ifndef NO_SDL
+extern DisplayBackend sdl_display;
+#endif
+
+static DisplayBackend *backends[] = {
+#ifndef NO_SDL
+  &sdl_display,
+#endif
+  &none_display, &ppm_display, &yuv_display, &shm_display,
+};
+
+#define NR_BACKEND (sizeof(backends) / sizeof(backends[0]))
+
+static DisplayBackend *display;
+static const char *display_arg;
+
+
+static void timer_tick() {
+  if (rec_mode == REC_RECORD) {
+    rec_log(REC_TICK, 0);
+  }
 
-static void timer_sig_handler(int signum) {
   jiffy ++;
   timer_intr();
 
@@ -32,67 +88,332 @@ static void timer_sig_handler(int signum) {
   if (jiffy % (TIMER_HZ / VGA_HZ) == 0) {
     update_screen_flag = true;
   }
+}
 
-  int ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
-  Assert(ret == 0, "Can not set timer");
+/* The tick is taken by the CPU thread between two instructions, so it
+ * happens at an exact instruction, which can be recorded.
+ */
+static void timer_sig_handler(int signum) {
+  is_tick_pending = true;
+  cpu_request_exit();
+}
+
+/* When the guest keeps polling devices without finding anything new, or
+ * executes `hlt', it is idle. Then the CPU thread sleeps until the next
+ * tick of the timer or an input event, instead of spinning on a host core.
+ */
+#define IDLE_POLL_GAP 512   /* polls further apart than this are not a polling loop */
+#define IDLE_NR_POLL 128    /* empty polls in a row to be idle */
+
+static uint64_t last_poll_instr = 0;
+static int nr_empty_poll = 0;
+static bool is_idle = false;
+
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static bool has_input = false;
+/* the host time when the virtual clock starts */
+static uint64_t vclock_boot_us = 0;
+
+static uint64_t get_host_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void device_poll(bool is_empty) {
+  if (!is_empty || nr_guest_instr - last_poll_instr > IDLE_POLL_GAP) {
+    nr_empty_poll = 0;
+  }
+  else if (++ nr_empty_poll >= IDLE_NR_POLL) {
+    nr_empty_poll = 0;
+    is_idle = true;
+    cpu_request_exit();
+  }
+  last_poll_instr = nr_guest_instr;
+}
+
+void device_idle() {
+  is_idle = true;
+  cpu_request_exit();
 }
 
+static void idle_wakeup() {
+  pthread_mutex_lock(&idle_lock);
+  has_input = true;
+  pthread_cond_signal(&idle_cond);
+  pthread_mutex_unlock(&idle_lock);
+}
+
+/* Sleep for at most `us' microseconds. Return false if woken up by input. */
+static bool idle_wait(uint64_t us) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += us / 1000000;
+  deadline.tv_nsec += (us % 1000000) * 1000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec ++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  int ret = 0;
+  pthread_mutex_lock(&idle_lock);
+  while (!has_input && ret != ETIMEDOUT) {
+    ret = pthread_cond_timedwait(&idle_cond, &idle_lock, &deadline);
+  }
+  bool is_timeout = !has_input;
+  has_input = false;
+  pthread_mutex_unlock(&idle_lock);
+  return is_timeout;
+}
+
+static void idle() {
+  if (vclock_period != 0) {
+    /* Fast-forward the virtual clock to the next tick, so the guest sees
+     * the same time as if it kept spinning. The host still sleeps until
+     * its time catches up, otherwise an idle guest would spin through
+     * ticks while waiting for input.
+     */
+    vclock_skip(vclock_next_tick - vclock_instr());
+    if (rec_mode == REC_REPLAY) {
+      /* replay as fast as possible */
+      return;
+    }
+    uint64_t guest_us = vclock_instr() * (1000000 / TIMER_HZ) / vclock_period;
+    uint64_t host_us = get_host_us() - vclock_boot_us;
+    if (guest_us > host_us) {
+      idle_wait(guest_us - host_us);
+    }
+  }
+  else if (rec_mode != REC_REPLAY && !is_tick_pending) {
+    /* the host timer keeps going while sleeping, wait for its next tick */
+    struct itimerspec left;
+    timer_gettime(host_timer, &left);
+    idle_wait(left.it_value.tv_nsec / 1000 + 1);
+  }
+}
+
+static bool is_quit = false;
+
+/* called by the display thread */
+void display_send_key(uint32_t am_key, bool is_keydown) {
+  send_key(am_key, is_keydown);
+  cpu_request_exit();
+  idle_wakeup();
+}
+
+void display_quit() {
+  __atomic_store_n(&is_quit, true, __ATOMIC_RELEASE);
+  cpu_request_exit();
+  idle_wakeup();
+}
+
+/* The display thread owns the backend. It presents the frames handed
+ * over by update_screen() and polls input events, so the CPU thread is
+ * not stalled by the presentation.
+ */
+static void* display_thread(void *arg) {
+  /* the timer signal should be handled by the CPU thread */
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, TIMER_SIG);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  display->init(display_arg);
+
+  while (1) {
+    present_screen(display);
+    if (display->poll_event != NULL) {
+      display->poll_event();
+    }
+  }
+
+  return NULL;
+}
+
+/* `spec' is "backend[:arg]" */
+static void init_display(const char *spec) {
+  if (spec == NULL) {
+    spec = backends[0]->name;
+  }
+
+  const char *colon = strchr(spec, ':');
+  int len = (colon != NULL ? colon - spec : strlen(spec));
+  display_arg = (colon != NULL ? colon + 1 : NULL);
+
+  int i;
+  for (i = 0; i < NR_BACKEND; i ++) {
+    if (strncmp(backends[i]->name, spec, len) == 0 && backends[i]->name[len] == '\0') {
+      display = backends[i];
+      Log("Display backend: %s", spec);
+      return;
+    }
+  }
+  panic("Unknown display backend '%s'", spec);
+}
+
+/* The next instruction at which device_update() must be called without an
+ * exit request: the next tick of the virtual clock, or the next event to
+ * replay. The events are replayed at exactly the same instructions.
+ */
+static void update_exit_instr() {
+  if (rec_mode == REC_REPLAY) {
+    cpu_exit_instr = rec_next_instr();
+  }
+  else if (vclock_period != 0) {
+    uint64_t now = vclock_instr();
+    cpu_exit_instr = nr_guest_instr + (vclock_next_tick > now ? vclock_next_tick - now : 0);
+  }
+  else {
+    cpu_exit_instr = UINT64_MAX;
+  }
+}
+
+/* called by cpu_exec() when requested, see cpu_exit_request */
 void device_update() {
-  if (!device_update_flag) {
-    return;
+  i8042_update();
+
+  if (is_idle) {
+    is_idle = false;
+    uint64_t t0 = get_host_ns();
+    idle();
+    perf_idle_ns += get_host_ns() - t0;
   }
-  device_update_flag = false;
-
-  if (update_screen_flag) {
-    update_screen();
-    update_screen_flag = false;
-  }
-
-  SDL_Event event;
-  while (SDL_PollEvent(&event)) {
-    switch (event.type) {
-      case SDL_QUIT: exit(0);
-
-                     // If a key was pressed
-      case SDL_KEYDOWN:
-      case SDL_KEYUP: {
-                        if (event.key.repeat == 0) {
-                          uint8_t k = event.key.keysym.scancode;
-                          bool is_keydown = (event.key.type == SDL_KEYDOWN);
-                          send_key(k, is_keydown);
-                          break;
-                        }
-                      }
-      default: break;
+
+  if (rec_mode == REC_REPLAY) {
+    /* the ticks come from the log */
+    if (rec_replay(REC_TICK, NULL)) {
+      vclock_next_tick += vclock_period;
+      timer_tick();
+    }
+  }
+  else if (vclock_period != 0) {
+    if (vclock_instr() >= vclock_next_tick) {
+      vclock_next_tick += vclock_period;
+      timer_tick();
+    }
+  }
+  else if (is_tick_pending) {
+    is_tick_pending = false;
+    timer_tick();
+  }
+
+  poll_key_script();
+
+  if (device_update_flag) {
+    device_update_flag = false;
+    uint64_t t0 = (perf_is_on ? get_host_ns() : 0);
+
+    serial_update();
+
+    if (update_screen_flag) {
+      update_screen();
+      update_screen_flag = false;
+      intc_raise(IRQ_VBLANK);
+    }
+    if (perf_is_on) { perf_device_ns += get_host_ns() - t0; }
+
+    bool quit = __atomic_load_n(&is_quit, __ATOMIC_ACQUIRE);
+    if (rec_mode == REC_REPLAY) {
+      quit = rec_replay(REC_QUIT, NULL) || quit;
+    }
+    else if (quit && rec_mode == REC_RECORD) {
+      rec_log(REC_QUIT, 0);
     }
+    if (quit) {
+      exit(0);
+    }
+  }
+
+  if (rec_mode == REC_REPLAY && rec_replay(REC_END, NULL) && nemu_state == NEMU_RUNNING) {
+    Log("The replay finishes at %" PRIu64 " instructions", nr_guest_instr);
+    nemu_state = NEMU_STOP;
   }
+
+  update_exit_instr();
 }
 
 void sdl_clear_event_queue() {
-  SDL_Event event;
-  while (SDL_PollEvent(&event));
+  clear_key_queue();
 }
 
-void init_device() {
-  init_serial();
+void init_device(const char *display_spec, const char *key_script, const char *vclock,
+    const char *serial_in, const char *disk_img) {
+  init_intc();
+  init_serial(serial_in);
   init_timer();
   init_vga();
   init_i8042();
+  init_disk(disk_img);
+  init_blitter();
+  init_perfcnt();
 
+  init_display(display_spec);
+  if (key_script != NULL) {
+    /* The script sends keys from the CPU thread. The key queue only has
+     * one producer, so the backend should not have input of its own. */
+    Assert(display->poll_event == NULL,
+        "A key script needs a headless display backend, such as -s none");
+    init_key_script(key_script);
+    /* the script is timed by the virtual clock */
+    if (vclock == NULL) {
+      vclock = KEY_SCRIPT_MIPS;
+    }
+  }
+
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, display_thread, NULL);
+  Assert(ret == 0, "Can not create the display thread");
+
+  if (vclock != NULL) {
+    int mips = atoi(vclock);
+    Assert(mips > 0, "Bad MIPS rate '%s' of the virtual clock", vclock);
+    init_vclock(mips);
+    vclock_period = (uint64_t)mips * 1000000 / TIMER_HZ;
+    vclock_next_tick = vclock_period;
+    vclock_boot_us = get_host_us();
+    Log("Virtual clock at %d MIPS", mips);
+    return;
+  }
+
+  /* The ticks follow the wall clock, so their rate does not depend on
+   * how much CPU time the display thread takes. The signal is sent to the
+   * CPU thread, which takes the tick.
+   */
   struct sigaction s;
   memset(&s, 0, sizeof(s));
   s.sa_handler = timer_sig_handler;
-  int ret = sigaction(SIGVTALRM, &s, NULL);
+  s.sa_flags = SA_RESTART;
+  ret = sigaction(TIMER_SIG, &s, NULL);
   Assert(ret == 0, "Can not set signal handler");
 
+  struct sigevent sev;
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = TIMER_SIG;
+  sev.sigev_notify_thread_id = syscall(SYS_gettid);
+  ret = timer_create(CLOCK_MONOTONIC, &sev, &host_timer);
+  Assert(ret == 0, "Can not create timer");
+
+  struct itimerspec it;
   it.it_value.tv_sec = 0;
-  it.it_value.tv_usec = 1000000 / TIMER_HZ;
-  ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
+  it.it_value.tv_nsec = 1000000000 / TIMER_HZ;
+  it.it_interval = it.it_value;
+  ret = timer_settime(host_timer, 0, &it, NULL);
   Assert(ret == 0, "Can not set timer");
 }
 #else
 
-void init_device() {
+#include "device/device.h"
+
+void init_device(const char *display_spec, const char *key_script, const char *vclock,
+    const char *serial_in, const char *disk_img) {
+}
+
+void device_poll(bool is_empty) {
+}
+
+void device_idle() {
 }
 
 #endif	/* HAS_IOE */
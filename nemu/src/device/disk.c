@@ -0,0 +1,149 @@
+#include "nemu.h"
+
+#ifdef HAS_IOE
+
+#include "device/mmio.h"
+#include "device/device.h"
+#include "device/intc.h"
+#include "device/record.h"
+#include <stddef.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* A disk controller with descriptor based DMA. The disk is a host file
+ * mapped into NEMU, so it can be much larger than the guest memory.
+ *
+ * To start a transfer, the guest puts a chain of descriptors in its
+ * memory, writes the physical address of the first one into DESC, and
+ * writes DISK_CMD_START into CMD. The transfer is finished when the
+ * write to CMD returns, and IRQ_DISK is raised.
+ */
+#define DISK_MMIO 0xc0000
+
+#define DISK_REG_SIZE_LO 0x00   /* size of the disk in bytes, read only */
+#define DISK_REG_SIZE_HI 0x04
+#define DISK_REG_DESC    0x08   /* physical address of the first descriptor */
+#define DISK_REG_CMD     0x0c
+#define DISK_REG_STATUS  0x10   /* DISK_STATUS_* of the last transfer */
+#define DISK_REG_END     0x14
+
+#define DISK_CMD_START 1
+
+#define DISK_OP_READ  0   /* disk to memory */
+#define DISK_OP_WRITE 1   /* memory to disk */
+
+#define DISK_STATUS_OK    0
+#define DISK_STATUS_ERROR 1
+
+typedef struct {
+  uint32_t op;
+  uint32_t addr;        /* physical address of the buffer */
+  uint32_t len;
+  uint32_t offset_lo;   /* position on the disk */
+  uint32_t offset_hi;
+  uint32_t next;        /* physical address of the next descriptor, 0 ends the chain */
+  uint32_t status;      /* written back by the controller */
+  uint32_t pad;
+} DiskDesc;
+
+/* a chain longer than this is regarded as a loop */
+#define MAX_DESC 65536
+
+static uint32_t *disk_base;
+static uint8_t *disk;
+static uint64_t disk_size = 0;
+
+static inline bool in_pmem(paddr_t addr, uint32_t len) {
+  return addr < PMEM_SIZE && len <= PMEM_SIZE - addr;
+}
+
+/* The reference of differential testing does not have the disk, so
+ * the writes to the guest memory should be reported.
+ */
+static inline void dma_write(paddr_t addr, const void *buf, uint32_t len) {
+#ifdef DIFF_TEST
+  void difftest_log_dma(paddr_t, size_t);
+  difftest_log_dma(addr, len);
+#endif
+  memcpy(guest_to_host(addr), buf, len);
+}
+
+static uint32_t disk_do_desc(DiskDesc *d) {
+  uint64_t offset = ((uint64_t)d->offset_hi << 32) | d->offset_lo;
+  if (!in_pmem(d->addr, d->len) || offset > disk_size || d->len > disk_size - offset) {
+    return DISK_STATUS_ERROR;
+  }
+
+  switch (d->op) {
+    case DISK_OP_READ: dma_write(d->addr, disk + offset, d->len); break;
+    case DISK_OP_WRITE: memcpy(disk + offset, guest_to_host(d->addr), d->len); break;
+    default: return DISK_STATUS_ERROR;
+  }
+  return DISK_STATUS_OK;
+}
+
+static uint32_t disk_start() {
+  paddr_t addr = disk_base[DISK_REG_DESC / 4];
+  int n;
+  for (n = 0; addr != 0 && n < MAX_DESC; n ++) {
+    if (!in_pmem(addr, sizeof(DiskDesc))) {
+      return DISK_STATUS_ERROR;
+    }
+
+    DiskDesc d;
+    memcpy(&d, guest_to_host(addr), sizeof(d));
+    d.status = disk_do_desc(&d);
+    dma_write(addr + offsetof(DiskDesc, status), &d.status, sizeof(d.status));
+    if (d.status != DISK_STATUS_OK) {
+      return d.status;
+    }
+    addr = d.next;
+  }
+  return (addr == 0 ? DISK_STATUS_OK : DISK_STATUS_ERROR);
+}
+
+void disk_io_handler(paddr_t addr, int len, bool is_write) {
+  if (is_write && addr - DISK_MMIO == DISK_REG_CMD) {
+    if (disk_base[DISK_REG_CMD / 4] == DISK_CMD_START) {
+      disk_base[DISK_REG_STATUS / 4] = disk_start();
+      device_poll(false);
+      intc_raise(IRQ_DISK);
+#ifdef DIFF_TEST
+      void diff_test_skip_qemu();
+      diff_test_skip_qemu();
+#endif
+    }
+  }
+}
+
+/* `file' is the image of the disk, the disk is empty if it is NULL */
+void init_disk(const char *file) {
+  disk_base = add_mmio_map("disk", DISK_MMIO, DISK_REG_END, disk_io_handler);
+
+  if (file != NULL) {
+    int fd = open(file, O_RDWR);
+    Assert(fd != -1, "Can not open '%s'", file);
+    struct stat st;
+    int ret = fstat(fd, &st);
+    assert(ret == 0);
+    disk_size = st.st_size;
+
+    if (disk_size != 0) {
+      /* Keep the image unmodified when recording or replaying, so that
+       * the replay starts from the same disk as the recording. */
+      int flags = (rec_mode == REC_NONE ? MAP_SHARED : MAP_PRIVATE);
+      disk = mmap(NULL, disk_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+      Assert(disk != MAP_FAILED, "Can not map '%s'", file);
+    }
+    close(fd);
+    Log("The disk is %s, %" PRIu64 " bytes", file, disk_size);
+  }
+
+  disk_base[DISK_REG_SIZE_LO / 4] = disk_size;
+  disk_base[DISK_REG_SIZE_HI / 4] = disk_size >> 32;
+}
+
+#endif	/* HAS_IOE */
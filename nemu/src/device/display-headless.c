@@ -0,0 +1,261 @@
+#include "common.h"
+
+#ifdef HAS_IOE
+
+#include "device/display.h"
+#include "device/keyboard.h"
+#include "device/device.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Headless backends, for running without a window. A frame is only
+ * written when the guest has changed the screen.
+ */
+
+static uint32_t frame[SCREEN_H][SCREEN_W];
+static int nr_frame = 0;
+
+static void frame_update(uint32_t (*pixels)[SCREEN_W], int y, int h) {
+  memcpy(frame[y], pixels[y], h * sizeof(frame[0]));
+}
+
+/* none: discard the frames */
+static void none_init(const char *arg) { }
+static void none_update(uint32_t (*pixels)[SCREEN_W], int y, int h) { }
+static void none_present() { }
+
+DisplayBackend none_display = {
+  .name = "none",
+  .init = none_init,
+  .update = none_update,
+  .present = none_present,
+};
+
+/* ppm:prefix - each frame to prefix-NNNNNN.ppm */
+static const char *ppm_prefix;
+
+static void ppm_init(const char *arg) {
+  ppm_prefix = (arg != NULL ? arg : "frame");
+}
+
+static void ppm_present() {
+  char path[256];
+  snprintf(path, sizeof(path), "%s-%06d.ppm", ppm_prefix, nr_frame ++);
+  FILE *fp = fopen(path, "wb");
+  Assert(fp, "Can not open '%s'", path);
+
+  static uint8_t rgb[SCREEN_H * SCREEN_W * 3];
+  uint8_t *p = rgb;
+  int x, y;
+  for (y = 0; y < SCREEN_H; y ++) {
+    for (x = 0; x < SCREEN_W; x ++) {
+      uint32_t c = frame[y][x];
+      *p ++ = c >> 16;
+      *p ++ = c >> 8;
+      *p ++ = c;
+    }
+  }
+
+  fprintf(fp, "P6\n%d %d\n255\n", SCREEN_W, SCREEN_H);
+  int ret = fwrite(rgb, sizeof(rgb), 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+}
+
+DisplayBackend ppm_display = {
+  .name = "ppm",
+  .init = ppm_init,
+  .update = frame_update,
+  .present = ppm_present,
+};
+
+/* yuv:file - append each frame to a raw I420 (yuv420p) stream */
+static FILE *yuv_fp;
+
+static void yuv_init(const char *arg) {
+  const char *path = (arg != NULL ? arg : "nemu.yuv");
+  yuv_fp = fopen(path, "wb");
+  Assert(yuv_fp, "Can not open '%s'", path);
+}
+
+static void yuv_present() {
+  static uint8_t Y[SCREEN_H][SCREEN_W];
+  static uint8_t U[SCREEN_H / 2][SCREEN_W / 2], V[SCREEN_H / 2][SCREEN_W / 2];
+  int x, y;
+  /* BT.601, limited range */
+  for (y = 0; y < SCREEN_H; y ++) {
+    for (x = 0; x < SCREEN_W; x ++) {
+      uint32_t c = frame[y][x];
+      int r = (c >> 16) & 0xff, g = (c >> 8) & 0xff, b = c & 0xff;
+      Y[y][x] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+      if ((x & 1) == 0 && (y & 1) == 0) {
+        U[y / 2][x / 2] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        V[y / 2][x / 2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+      }
+    }
+  }
+
+  int ret = fwrite(Y, sizeof(Y), 1, yuv_fp);
+  ret += fwrite(U, sizeof(U), 1, yuv_fp);
+  ret += fwrite(V, sizeof(V), 1, yuv_fp);
+  assert(ret == 3);
+  fflush(yuv_fp);
+  nr_frame ++;
+}
+
+DisplayBackend yuv_display = {
+  .name = "yuv",
+  .init = yuv_init,
+  .update = frame_update,
+  .present = yuv_present,
+};
+
+/* shm:name - share the frame buffer through POSIX shared memory.
+ * `seq' is odd while a frame is being written and even after it is
+ * complete, so a reader should retry if it is odd or has changed while
+ * copying the pixels.
+ */
+typedef struct {
+  uint32_t width, height;
+  uint32_t seq;
+  uint32_t pad;
+  uint32_t pixels[SCREEN_H][SCREEN_W];
+} ShmFrame;
+
+static ShmFrame *shm_frame;
+static bool is_shm_writing = false;
+
+static void shm_init(const char *arg) {
+  const char *name = (arg != NULL ? arg : "/nemu-screen");
+  int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  Assert(fd != -1, "Can not open shared memory '%s'", name);
+  int ret = ftruncate(fd, sizeof(ShmFrame));
+  Assert(ret == 0, "Can not resize shared memory '%s'", name);
+  shm_frame = mmap(NULL, sizeof(ShmFrame), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  Assert(shm_frame != MAP_FAILED, "Can not map shared memory '%s'", name);
+  close(fd);
+
+  shm_frame->width = SCREEN_W;
+  shm_frame->height = SCREEN_H;
+  shm_frame->seq = 0;
+}
+
+static void shm_update(uint32_t (*pixels)[SCREEN_W], int y, int h) {
+  if (!is_shm_writing) {
+    __atomic_store_n(&shm_frame->seq, shm_frame->seq + 1, __ATOMIC_RELEASE);
+    is_shm_writing = true;
+  }
+  memcpy(shm_frame->pixels[y], pixels[y], h * sizeof(pixels[0]));
+}
+
+static void shm_present() {
+  __atomic_store_n(&shm_frame->seq, shm_frame->seq + 1, __ATOMIC_RELEASE);
+  is_shm_writing = false;
+  nr_frame ++;
+}
+
+DisplayBackend shm_display = {
+  .name = "shm",
+  .init = shm_init,
+  .update = shm_update,
+  .present = shm_present,
+};
+
+/* Scripted key input. Each line of the script is
+ *   <ms> kd <KEY>    press a key
+ *   <ms> ku <KEY>    release a key
+ *   <ms> quit        stop NEMU
+ * where <ms> is the time of the virtual clock, and <KEY> is the name of
+ * an AM key, such as RETURN. The time counts guest instructions, so a
+ * script is played the same way however fast the host is. Empty lines
+ * and lines beginning with '#' are ignored. The lines should be sorted
+ * by time.
+ */
+#define NAME(k) #k,
+static const char *key_names[] = {
+  [_KEY_NONE] = "NONE",
+  _KEYS(NAME)
+};
+
+static FILE *key_script_fp = NULL;
+static const char *key_script_file;
+static int key_script_line = 0;
+
+typedef struct {
+  long ms;
+  char cmd[8];
+  uint32_t key;
+} KeyScriptEvent;
+
+static KeyScriptEvent next_event;
+static bool has_next_event = false;
+
+static bool read_key_script_event(KeyScriptEvent *e) {
+  char line[128];
+  while (fgets(line, sizeof(line), key_script_fp) != NULL) {
+    key_script_line ++;
+    char name[32];
+    int n = sscanf(line, "%ld %7s %31s", &e->ms, e->cmd, name);
+    if (n <= 0 || line[0] == '#') {
+      continue;
+    }
+
+    if (n == 2 && strcmp(e->cmd, "quit") == 0) {
+      return true;
+    }
+    Assert(n == 3 && (strcmp(e->cmd, "kd") == 0 || strcmp(e->cmd, "ku") == 0),
+        "%s:%d: bad key event", key_script_file, key_script_line);
+
+    for (e->key = 1; e->key < sizeof(key_names) / sizeof(key_names[0]); e->key ++) {
+      if (strcmp(key_names[e->key], name) == 0) {
+        return true;
+      }
+    }
+    panic("%s:%d: unknown key '%s'", key_script_file, key_script_line, name);
+  }
+  return false;
+}
+
+/* Called by the CPU thread in device_update(). It is then the only
+ * producer of the key queue, since only headless backends are allowed
+ * with a key script, see init_device(). */
+void poll_key_script() {
+  if (key_script_fp == NULL) {
+    return;
+  }
+
+  long ms = vclock_instr() / (vclock_get_mips() * 1000);
+
+  while (1) {
+    if (!has_next_event) {
+      if (!read_key_script_event(&next_event)) {
+        fclose(key_script_fp);
+        key_script_fp = NULL;
+        return;
+      }
+      has_next_event = true;
+    }
+
+    if (next_event.ms > ms) {
+      return;
+    }
+
+    has_next_event = false;
+    if (strcmp(next_event.cmd, "quit") == 0) {
+      display_quit();
+    }
+    else {
+      display_send_key(next_event.key, strcmp(next_event.cmd, "kd") == 0);
+    }
+  }
+}
+
+void init_key_script(const char *file) {
+  key_script_file = file;
+  key_script_fp = fopen(file, "r");
+  Assert(key_script_fp, "Can not open '%s'", file);
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include "common.h"
+
+#if defined(HAS_IOE) && !defined(NO_SDL)
+
+#include "device/display.h"
+#include "device/keyboard.h"
+#include <SDL2/SDL.h>
+
+static SDL_Window *window;
+static SDL_Renderer *renderer;
+static SDL_Texture *texture;
+
+#define XX(k) [concat(SDL_SCANCODE_, k)] = concat(_KEY_, k),
+static uint32_t keymap[256] = {
+  _KEYS(XX)
+};
+
+static void sdl_init(const char *arg) {
+  SDL_Init(SDL_INIT_VIDEO);
+  SDL_CreateWindowAndRenderer(SCREEN_W * 2, SCREEN_H * 2, 0, &window, &renderer);
+  SDL_SetWindowTitle(window, "NEMU");
+  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+      SDL_TEXTUREACCESS_STATIC, SCREEN_W, SCREEN_H);
+}
+
+static void sdl_update(uint32_t (*pixels)[SCREEN_W], int y, int h) {
+  SDL_Rect rect = { .x = 0, .y = y, .w = SCREEN_W, .h = h };
+  SDL_UpdateTexture(texture, &rect, pixels[y], SCREEN_W * sizeof(pixels[0][0]));
+}
+
+static void sdl_present() {
+  SDL_RenderClear(renderer);
+  SDL_RenderCopy(renderer, texture, NULL, NULL);
+  SDL_RenderPresent(renderer);
+}
+
+static void sdl_poll_event() {
+  SDL_Event event;
+  while (SDL_PollEvent(&event)) {
+    switch (event.type) {
+      case SDL_QUIT: display_quit(); break;
+
+                     // If a key was pressed
+      case SDL_KEYDOWN:
+      case SDL_KEYUP: {
+                        if (event.key.repeat == 0) {
+                          uint8_t k = event.key.keysym.scancode;
+                          bool is_keydown = (event.key.type == SDL_KEYDOWN);
+                          display_send_key(keymap[k], is_keydown);
+                          break;
+                        }
+                      }
+      default: break;
+    }
+  }
+}
+
+DisplayBackend sdl_display = {
+  .name = "sdl",
+  .init = sdl_init,
+  .update = sdl_update,
+  .present = sdl_present,
+  .poll_event = sdl_poll_event,
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "common.h"
+#include "device/port-io.h"
+#include "device/intc.h"
+
+/* An interrupt controller. Each line has a bit in the registers below.
+ * A device raises a line to set its pending bit. A pending line which is
+ * not masked, and has a higher priority than all lines in service, is
+ * delivered to the CPU through the INTR pin.
+ *
+ *   PENDING    (r)   lines raised but not acknowledged yet
+ *   MASK       (r/w) masked lines, all lines are masked at reset
+ *   ACK        (r)   acknowledge the line to deliver, and put it in
+ *                    service; the number of the line, or -1 if none
+ *   EOI        (w)   the number of the line whose service is finished
+ *   IN_SERVICE (r)   lines in service
+ */
+#define INTC_PORT 0x20   // Note that this is not the standard
+
+#define INTC_REG_PENDING    0x0
+#define INTC_REG_MASK       0x4
+#define INTC_REG_ACK        0x8
+#define INTC_REG_EOI        0xc
+#define INTC_REG_IN_SERVICE 0x10
+#define INTC_REG_END        0x14
+
+#define ALL_LINES ((1u << NR_IRQ_LINE) - 1)
+
+static uint32_t *intc_base;
+
+/* Devices may raise a line in the handler of the host timer signal, so
+ * the pending bits are updated atomically.
+ */
+static uint32_t pending = 0;
+static uint32_t mask = ALL_LINES;
+static uint32_t in_service = 0;
+
+static const char *irq_name[NR_IRQ_LINE] = { "timer", "keyboard", "disk", "vblank" };
+static uint64_t nr_raised[NR_IRQ_LINE];
+static uint64_t nr_acked[NR_IRQ_LINE];
+
+static inline uint32_t deliverable() {
+  uint32_t lines = __atomic_load_n(&pending, __ATOMIC_ACQUIRE) & ~mask;
+  if (in_service != 0) {
+    /* only the lines with a higher priority than those in service */
+    lines &= (in_service & -in_service) - 1;
+  }
+  return lines;
+}
+
+static inline void update_intr() {
+  if (deliverable() != 0) {
+    extern void dev_raise_intr(void);
+    dev_raise_intr();
+  }
+}
+
+void intc_raise(int irq) {
+  assert(irq >= 0 && irq < NR_IRQ_LINE);
+  nr_raised[irq] ++;
+  __atomic_fetch_or(&pending, 1u << irq, __ATOMIC_RELEASE);
+  update_intr();
+}
+
+int intc_ack() {
+  uint32_t lines = deliverable();
+  if (lines == 0) {
+    return -1;
+  }
+
+  int irq = __builtin_ctz(lines);
+  __atomic_fetch_and(&pending, ~(1u << irq), __ATOMIC_ACQ_REL);
+  in_service |= 1u << irq;
+  nr_acked[irq] ++;
+  return irq;
+}
+
+/* the name of line `irq', the times it is raised and acknowledged */
+void intc_stat(int irq, const char **name, uint64_t *raised, uint64_t *acked) {
+  assert(irq >= 0 && irq < NR_IRQ_LINE);
+  *name = irq_name[irq];
+  *raised = nr_raised[irq];
+  *acked = nr_acked[irq];
+}
+
+void intc_io_handler(ioaddr_t addr, int len, bool is_write) {
+  switch (addr - INTC_PORT) {
+    case INTC_REG_PENDING:
+      if (!is_write) { intc_base[INTC_REG_PENDING / 4] = __atomic_load_n(&pending, __ATOMIC_ACQUIRE); }
+      break;
+    case INTC_REG_MASK:
+      if (is_write) {
+        mask = intc_base[INTC_REG_MASK / 4] & ALL_LINES;
+        update_intr();
+      }
+      intc_base[INTC_REG_MASK / 4] = mask;
+      break;
+    case INTC_REG_ACK:
+      if (!is_write) { intc_base[INTC_REG_ACK / 4] = intc_ack(); }
+      break;
+    case INTC_REG_EOI:
+      if (is_write && intc_base[INTC_REG_EOI / 4] < NR_IRQ_LINE) {
+        in_service &= ~(1u << intc_base[INTC_REG_EOI / 4]);
+        update_intr();
+      }
+      break;
+    case INTC_REG_IN_SERVICE:
+      if (!is_write) { intc_base[INTC_REG_IN_SERVICE / 4] = in_service; }
+      break;
+  }
+}
+
+void init_intc() {
+  intc_base = add_pio_map("intc", INTC_PORT, INTC_REG_END, intc_io_handler);
+  intc_base[INTC_REG_MASK / 4] = mask;
+}
@@ -1,57 +1,133 @@
 #include "common.h"
 #include "device/mmio.h"
+#include "memory/mmu.h"
+#include "monitor/perf.h"
+#include <stdlib.h>
 
-#define MMIO_SPACE_MAX (512 * 1024)
-#define NR_MAP 8
-
-static uint8_t mmio_space_pool[MMIO_SPACE_MAX];
-static uint32_t mmio_space_free_index = 0;
+/* The physical address space is indexed by a two-level table like the
+ * x86 page table. Each page of a mapped region records the number of its
+ * map, so looking up an address does not depend on the number of maps.
+ * The second level is only allocated for the 4MB regions with devices.
+ */
+#define NR_L2 NR_PTE
+#define L1_IDX(addr) ((addr) >> 22)
+#define L2_IDX(addr) (((addr) >> 12) & (NR_L2 - 1))
 
 typedef struct {
   paddr_t low;
   paddr_t high;
   uint8_t *mmio_space;
   mmio_callback_t callback;
+  IOStat stat;
 } MMIO_t;
 
-static MMIO_t maps[NR_MAP];
-static int nr_map = 0;
+static MMIO_t *maps = NULL;
+static int nr_map = 0, max_map = 0;
+
+/* map_NO + 1 of each page, 0 means not mapped */
+static uint16_t *page_table[NR_PDE];
 
 /* device interface */
-void* add_mmio_map(paddr_t addr, int len, mmio_callback_t callback) {
-  assert(nr_map < NR_MAP);
-  assert(mmio_space_free_index + len <= MMIO_SPACE_MAX);
+void* add_mmio_map(const char *name, paddr_t addr, int len, mmio_callback_t callback) {
+  assert(len > 0);
+  Assert((addr & PAGE_MASK) == 0, "MMIO region at 0x%08x should be page aligned", addr);
+  assert(nr_map + 1 < UINT16_MAX);
+
+  if (nr_map == max_map) {
+    max_map = (max_map == 0 ? 8 : max_map * 2);
+    maps = realloc(maps, sizeof(MMIO_t) * max_map);
+    assert(maps != NULL);
+  }
+
+  /* "+ 3" is for hacking, see mmio_read() below */
+  uint8_t *space_base = calloc(len + 3, 1);
+  assert(space_base != NULL);
 
-  uint8_t *space_base = &mmio_space_pool[mmio_space_free_index];
   maps[nr_map].low = addr;
   maps[nr_map].high = addr + len - 1;
   maps[nr_map].mmio_space = space_base;
   maps[nr_map].callback = callback;
+  maps[nr_map].stat = (IOStat) { .name = name };
+
+  paddr_t page;
+  for (page = addr; page - addr < len; page += PAGE_SIZE) {
+    uint16_t **l2 = &page_table[L1_IDX(page)];
+    if (*l2 == NULL) {
+      *l2 = calloc(NR_L2, sizeof(uint16_t));
+      assert(*l2 != NULL);
+    }
+    Assert((*l2)[L2_IDX(page)] == 0, "MMIO region at 0x%08x overlaps with another one", page);
+    (*l2)[L2_IDX(page)] = nr_map + 1;
+  }
+
   nr_map ++;
-  mmio_space_free_index += len;
   return space_base;
 }
 
+int nr_mmio_stat() {
+  return nr_map;
+}
+
+const IOStat* mmio_stat(int map_NO) {
+  return &maps[map_NO].stat;
+}
+
+static inline void mmio_callback(MMIO_t *map, paddr_t addr, int len, bool is_write) {
+  if (is_write) { map->stat.nr_write ++; }
+  else { map->stat.nr_read ++; }
+
+  if (!perf_is_on) {
+    map->callback(addr, len, is_write);
+    return;
+  }
+
+  uint64_t t0 = get_host_ns();
+  map->callback(addr, len, is_write);
+  uint64_t t = get_host_ns() - t0;
+  map->stat.ns += t;
+  perf_device_ns += t;
+}
+
 /* bus interface */
 int is_mmio(paddr_t addr) {
-  int i;
-  for (i = 0; i < nr_map; i ++) {
-    if (addr >= maps[i].low && addr <= maps[i].high) {
-      return i;
-    }
+  uint16_t *l2 = page_table[L1_IDX(addr)];
+  if (l2 == NULL) {
+    return -1;
   }
-  return -1;
+
+  int map_NO = l2[L2_IDX(addr)] - 1;
+  if (map_NO != -1 && addr > maps[map_NO].high) {
+    /* in the last page of a region, but beyond its end */
+    return -1;
+  }
+  return map_NO;
 }
 
 uint32_t mmio_read(paddr_t addr, int len, int map_NO) {
   assert(len >= 1 && len <= 4);
   MMIO_t *map = &maps[map_NO];
-  uint32_t data = *(uint32_t *)(map->mmio_space + (addr - map->low)) 
+  uint32_t data = *(uint32_t *)(map->mmio_space + (addr - map->low))
     & (~0u >> ((4 - len) << 3));
-  map->callback(addr, len, false);
+  mmio_callback(map, addr, len, false);
   return data;
 }
 
+/* The host address of [addr, addr + len) in the map `map_NO', or NULL
+ * if the range runs out of the map.
+ */
+void* mmio_to_host(paddr_t addr, uint32_t len, int map_NO) {
+  MMIO_t *map = &maps[map_NO];
+  if (addr < map->low || addr > map->high || len > map->high - addr + 1) {
+    return NULL;
+  }
+  return map->mmio_space + (addr - map->low);
+}
+
+/* Tell the device that [addr, addr + len) of its space has been written by DMA. */
+void mmio_dma_written(paddr_t addr, int len, int map_NO) {
+  maps[map_NO].callback(addr, len, true);
+}
+
 void mmio_write(paddr_t addr, int len, uint32_t data, int map_NO) {
   assert(len >= 1 && len <= 4);
   MMIO_t *map = &maps[map_NO];
@@ -66,5 +142,5 @@ void mmio_write(paddr_t addr, int len, uint32_t data, int map_NO) {
     case 1: p[0] = p_data[0]; break;
   }
 
-  maps[map_NO].callback(addr, len, true);
+  mmio_callback(map, addr, len, true);
 }
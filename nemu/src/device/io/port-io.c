@@ -1,8 +1,9 @@
 #include "common.h"
 #include "device/port-io.h"
+#include "monitor/perf.h"
+#include <stdlib.h>
 
 #define PORT_IO_SPACE_MAX 65536
-#define NR_MAP 8
 
 /* "+ 3" is for hacking, see pio_read() below */
 static uint8_t pio_space[PORT_IO_SPACE_MAX + 3];
@@ -11,32 +12,68 @@ typedef struct {
   ioaddr_t low;
   ioaddr_t high;
   pio_callback_t callback;
+  IOStat stat;
 } PIO_t;
 
-static PIO_t maps[NR_MAP];
-static int nr_map = 0;
+static PIO_t *maps = NULL;
+static int nr_map = 0, max_map = 0;
 
-static void pio_callback(ioaddr_t addr, int len, bool is_write) {
-  int i;
-  for (i = 0; i < nr_map; i ++) {
-    if (addr >= maps[i].low && addr + len - 1 <= maps[i].high) {
-      maps[i].callback(addr, len, is_write);
+/* map_NO + 1 of each port, 0 means no device */
+static uint16_t port_map[PORT_IO_SPACE_MAX];
+
+static inline void pio_callback(ioaddr_t addr, int len, bool is_write) {
+  int map_NO = port_map[addr] - 1;
+  if (map_NO != -1 && addr + len - 1 <= maps[map_NO].high) {
+    PIO_t *map = &maps[map_NO];
+    if (is_write) { map->stat.nr_write ++; }
+    else { map->stat.nr_read ++; }
+
+    if (!perf_is_on) {
+      map->callback(addr, len, is_write);
       return;
     }
+
+    uint64_t t0 = get_host_ns();
+    map->callback(addr, len, is_write);
+    uint64_t t = get_host_ns() - t0;
+    map->stat.ns += t;
+    perf_device_ns += t;
   }
 }
 
 /* device interface */
-void* add_pio_map(ioaddr_t addr, int len, pio_callback_t callback) {
-  assert(nr_map < NR_MAP);
+void* add_pio_map(const char *name, ioaddr_t addr, int len, pio_callback_t callback) {
   assert(addr + len <= PORT_IO_SPACE_MAX);
+  assert(nr_map + 1 < UINT16_MAX);
+
+  if (nr_map == max_map) {
+    max_map = (max_map == 0 ? 8 : max_map * 2);
+    maps = realloc(maps, sizeof(PIO_t) * max_map);
+    assert(maps != NULL);
+  }
+
   maps[nr_map].low = addr;
   maps[nr_map].high = addr + len - 1;
   maps[nr_map].callback = callback;
+  maps[nr_map].stat = (IOStat) { .name = name };
+
+  int i;
+  for (i = addr; i < addr + len; i ++) {
+    Assert(port_map[i] == 0, "port 0x%x is already mapped", i);
+    port_map[i] = nr_map + 1;
+  }
+
   nr_map ++;
   return pio_space + addr;
 }
 
+int nr_pio_stat() {
+  return nr_map;
+}
+
+const IOStat* pio_stat(int map_NO) {
+  return &maps[map_NO].stat;
+}
 
 /* CPU interface */
 uint32_t pio_read(ioaddr_t addr, int len) {
@@ -53,4 +90,3 @@ void pio_write(ioaddr_t addr, int len, uint32_t data) {
   memcpy(pio_space + addr, &data, len);
   pio_callback(addr, len, true);
 }
-
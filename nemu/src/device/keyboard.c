@@ -1,70 +1,149 @@
 #include "device/port-io.h"
+#include "device/keyboard.h"
+#include "device/intc.h"
+#include "device/device.h"
+#include "device/record.h"
 #include "monitor/monitor.h"
-#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <inttypes.h>
 
 #define I8042_DATA_PORT 0x60
 #define I8042_STATUS_PORT 0x64
 #define I8042_STATUS_HASKEY_MASK 0x1
 #define KEYBOARD_IRQ 1
 
+/* controller commands, written to the status port */
+#define I8042_CMD_READ_CONFIG 0x20
+#define I8042_CMD_WRITE_CONFIG 0x60
+#define I8042_CONFIG_IRQ_MASK 0x1
+
 static uint32_t *i8042_data_port_base;
 static uint8_t *i8042_status_port_base;
 
-#define _KEYS(_) \
-  _(ESCAPE) _(F1) _(F2) _(F3) _(F4) _(F5) _(F6) _(F7) _(F8) _(F9) _(F10) _(F11) _(F12) \
-_(GRAVE) _(1) _(2) _(3) _(4) _(5) _(6) _(7) _(8) _(9) _(0) _(MINUS) _(EQUALS) _(BACKSPACE) \
-_(TAB) _(Q) _(W) _(E) _(R) _(T) _(Y) _(U) _(I) _(O) _(P) _(LEFTBRACKET) _(RIGHTBRACKET) _(BACKSLASH) \
-_(CAPSLOCK) _(A) _(S) _(D) _(F) _(G) _(H) _(J) _(K) _(L) _(SEMICOLON) _(APOSTROPHE) _(RETURN) \
-_(LSHIFT) _(Z) _(X) _(C) _(V) _(B) _(N) _(M) _(COMMA) _(PERIOD) _(SLASH) _(RSHIFT) \
-_(LCTRL) _(APPLICATION) _(LALT) _(SPACE) _(RALT) _(RCTRL) \
-_(UP) _(DOWN) _(LEFT) _(RIGHT) _(INSERT) _(DELETE) _(HOME) _(END) _(PAGEUP) _(PAGEDOWN)
+/* The key queue is a single-producer single-consumer ring. The input
+ * thread pushes with send_key(), and the CPU thread pops when the guest
+ * polls the status port, so neither side takes a lock and a key is
+ * visible to the guest as soon as it is pushed.
+ */
+#define KEY_QUEUE_LEN 1024
+static uint32_t key_queue[KEY_QUEUE_LEN];
+static uint32_t key_f = 0, key_r = 0;
+static uint64_t nr_key_dropped = 0;
 
-#define _KEY_NAME(k) _KEY_##k,
+#define KEYDOWN_MASK 0x8000
 
-enum {
-  _KEY_NONE = 0,
-  _KEYS(_KEY_NAME)
-};
+static uint8_t i8042_status = 0;
+/* the configuration byte of the controller, only the IRQ bit is used */
+static uint8_t i8042_config = 0;
+static bool is_config_write = false;
+static bool is_irq_pending = false;
 
-#define XX(k) [concat(SDL_SCANCODE_, k)] = concat(_KEY_, k),
-static uint32_t keymap[256] = {
-  _KEYS(XX)
-};
+void send_key(uint32_t am_key, bool is_keydown) {
+  if (nemu_state == NEMU_RUNNING && am_key != _KEY_NONE) {
+    uint32_t r = key_r;
+    uint32_t next = (r + 1) % KEY_QUEUE_LEN;
+    if (next == __atomic_load_n(&key_f, __ATOMIC_ACQUIRE)) {
+      __atomic_add_fetch(&nr_key_dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
 
-#define KEY_QUEUE_LEN 1024
-static int key_queue[KEY_QUEUE_LEN];
-static int key_f = 0, key_r = 0;
+    key_queue[r] = am_key | (is_keydown ? KEYDOWN_MASK : 0);
+    __atomic_store_n(&key_r, next, __ATOMIC_RELEASE);
 
-#define KEYDOWN_MASK 0x8000
+    if (__atomic_load_n(&i8042_config, __ATOMIC_RELAXED) & I8042_CONFIG_IRQ_MASK) {
+      __atomic_store_n(&is_irq_pending, true, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+static inline bool key_queue_pop(uint32_t *key) {
+  uint32_t f = key_f;
+  if (f == __atomic_load_n(&key_r, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  *key = key_queue[f];
+  __atomic_store_n(&key_f, (f + 1) % KEY_QUEUE_LEN, __ATOMIC_RELEASE);
+  return true;
+}
+
+void clear_key_queue() {
+  uint32_t key;
+  while (key_queue_pop(&key));
+}
 
-void send_key(uint8_t scancode, bool is_keydown) {
-  if (nemu_state == NEMU_RUNNING &&
-      keymap[scancode] != _KEY_NONE) {
-    uint32_t am_scancode = keymap[scancode] | (is_keydown ? KEYDOWN_MASK : 0);
-    key_queue[key_r] = am_scancode;
-    key_r = (key_r + 1) % KEY_QUEUE_LEN;
+/* raise the keyboard IRQ for the keys pushed by the input thread */
+void i8042_update() {
+  if (rec_mode == REC_REPLAY) {
+    /* the keys come from the log, ignore those from the input thread */
+    if (rec_replay(REC_KEY_IRQ, NULL)) {
+      intc_raise(IRQ_KEYBOARD);
+    }
+    return;
+  }
+
+  if (__atomic_load_n(&is_irq_pending, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&is_irq_pending, false, __ATOMIC_ACQ_REL)) {
+    if (rec_mode == REC_RECORD) {
+      rec_log(REC_KEY_IRQ, 0);
+    }
+    intc_raise(IRQ_KEYBOARD);
   }
 }
 
 void i8042_io_handler(ioaddr_t addr, int len, bool is_write) {
   if (!is_write) {
     if (addr == I8042_DATA_PORT) {
-      i8042_status_port_base[0] &= ~I8042_STATUS_HASKEY_MASK;
+      i8042_status &= ~I8042_STATUS_HASKEY_MASK;
+      if ((i8042_config & I8042_CONFIG_IRQ_MASK) &&
+          key_f != __atomic_load_n(&key_r, __ATOMIC_ACQUIRE)) {
+        /* more keys are waiting */
+        __atomic_store_n(&is_irq_pending, true, __ATOMIC_RELEASE);
+      }
     }
     else if (addr == I8042_STATUS_PORT) {
-      if ((i8042_status_port_base[0] & I8042_STATUS_HASKEY_MASK) == 0) {
-        if (key_f != key_r) {
-          i8042_data_port_base[0] = key_queue[key_f];
-          i8042_status_port_base[0] |= I8042_STATUS_HASKEY_MASK;
-          key_f = (key_f + 1) % KEY_QUEUE_LEN;
+      if ((i8042_status & I8042_STATUS_HASKEY_MASK) == 0) {
+        uint32_t key;
+        if (rec_mode == REC_REPLAY ? rec_replay(REC_KEY, &key) : key_queue_pop(&key)) {
+          if (rec_mode == REC_RECORD) {
+            rec_log(REC_KEY, key);
+          }
+          i8042_data_port_base[0] = key;
+          i8042_status |= I8042_STATUS_HASKEY_MASK;
         }
       }
+      i8042_status_port_base[0] = i8042_status;
+      device_poll((i8042_status & I8042_STATUS_HASKEY_MASK) == 0);
     }
   }
+  else {
+    if (addr == I8042_STATUS_PORT) {
+      switch (i8042_status_port_base[0]) {
+        case I8042_CMD_READ_CONFIG:
+          i8042_data_port_base[0] = i8042_config;
+          break;
+        case I8042_CMD_WRITE_CONFIG:
+          is_config_write = true;
+          break;
+      }
+      /* the command is written over the status */
+      i8042_status_port_base[0] = i8042_status;
+    }
+    else if (addr == I8042_DATA_PORT && is_config_write) {
+      __atomic_store_n(&i8042_config, i8042_data_port_base[0], __ATOMIC_RELAXED);
+      is_config_write = false;
+    }
+  }
+}
+
+static void report_dropped_keys() {
+  if (nr_key_dropped != 0) {
+    printf("%" PRIu64 " key events are dropped since the key queue is full\n", nr_key_dropped);
+  }
 }
 
 void init_i8042() {
-  i8042_data_port_base = add_pio_map(I8042_DATA_PORT, 4, i8042_io_handler);
-  i8042_status_port_base = add_pio_map(I8042_STATUS_PORT, 1, i8042_io_handler);
-  i8042_status_port_base[0] = 0x0;
+  i8042_data_port_base = add_pio_map("i8042-data", I8042_DATA_PORT, 4, i8042_io_handler);
+  i8042_status_port_base = add_pio_map("i8042-status", I8042_STATUS_PORT, 1, i8042_io_handler);
+  i8042_status_port_base[0] = i8042_status;
+  atexit(report_dropped_keys);
 }
@@ -0,0 +1,63 @@
+#include "common.h"
+
+#ifdef HAS_IOE
+
+#include "device/port-io.h"
+#include "device/device.h"
+#include "device/record.h"
+#include "monitor/monitor.h"
+#include "monitor/perf.h"
+
+/* Performance counters of the guest. Each counter is 64-bit. Reading its
+ * low half takes a snapshot of the counter, so reading the high half
+ * after it gives a consistent value.
+ *
+ *   INSTR    retired instructions
+ *   LOAD     memory reads by instructions
+ *   STORE    memory writes by instructions
+ *   BRANCH   taken control transfers
+ *   TSC_MHZ  the rate of the TSC read by `rdtsc'. It is exact with the
+ *            virtual clock, otherwise it is the MIPS measured so far.
+ */
+#define PERFCNT_PORT 0x200   // Note that this is not the standard
+
+#define PERFCNT_REG_INSTR   0x00
+#define PERFCNT_REG_LOAD    0x08
+#define PERFCNT_REG_STORE   0x10
+#define PERFCNT_REG_BRANCH  0x18
+#define PERFCNT_REG_TSC_MHZ 0x20
+#define PERFCNT_REG_END     0x24
+
+static uint32_t *perfcnt_base;
+
+static inline void latch(int reg, uint64_t val) {
+  perfcnt_base[reg / 4] = val;
+  perfcnt_base[reg / 4 + 1] = val >> 32;
+}
+
+void perfcnt_io_handler(ioaddr_t addr, int len, bool is_write) {
+  if (is_write) {
+    return;
+  }
+
+  switch (addr - PERFCNT_PORT) {
+    case PERFCNT_REG_INSTR:  latch(PERFCNT_REG_INSTR, nr_guest_instr); break;
+    case PERFCNT_REG_LOAD:   latch(PERFCNT_REG_LOAD, nr_guest_load); break;
+    case PERFCNT_REG_STORE:  latch(PERFCNT_REG_STORE, nr_guest_store); break;
+    case PERFCNT_REG_BRANCH: latch(PERFCNT_REG_BRANCH, nr_guest_branch); break;
+    case PERFCNT_REG_TSC_MHZ: {
+      uint32_t mhz = vclock_get_mips();
+      if (mhz == 0) {
+        mhz = perf_host_mips();
+      }
+      perfcnt_base[PERFCNT_REG_TSC_MHZ / 4] = rec_value(REC_TSC_MHZ, mhz == 0 ? 1 : mhz);
+      break;
+    }
+  }
+}
+
+void init_perfcnt() {
+  perfcnt_base = add_pio_map("perfcnt", PERFCNT_PORT, PERFCNT_REG_END, perfcnt_io_handler);
+}
+
+#endif	/* HAS_IOE */
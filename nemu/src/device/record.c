@@ -0,0 +1,130 @@
+#include "common.h"
+#include "device/record.h"
+#include "monitor/monitor.h"
+#include <stdlib.h>
+#include <inttypes.h>
+
+#define REC_MAGIC "NEMUREC1"
+
+typedef struct {
+  uint64_t instr;
+  uint32_t type;
+  uint32_t data;
+} RecEvent;
+
+static const char *rec_name[NR_REC_TYPE] = {
+  [REC_TICK] = "tick", [REC_RTC] = "rtc", [REC_TSC_MHZ] = "tsc_mhz",
+  [REC_KEY] = "key", [REC_KEY_IRQ] = "key_irq", [REC_SERIAL] = "serial",
+  [REC_QUIT] = "quit", [REC_END] = "end",
+};
+
+int rec_mode = REC_NONE;
+static FILE *rec_fp = NULL;
+
+/* the next event to replay */
+static RecEvent next;
+static bool is_end = false;
+
+/* the last value of REC_RTC and REC_TSC_MHZ */
+static uint32_t last_value[NR_REC_TYPE];
+static bool has_value[NR_REC_TYPE];
+
+static void read_next() {
+  if (fread(&next, sizeof(next), 1, rec_fp) != 1) {
+    /* the recording is not closed normally */
+    is_end = true;
+    Log("The replay log ends without an end event at %" PRIu64 " instructions", nr_guest_instr);
+    return;
+  }
+  Assert(next.type < NR_REC_TYPE, "Bad event in the replay log");
+}
+
+void rec_log(int type, uint32_t data) {
+  RecEvent ev = { .instr = nr_guest_instr, .type = type, .data = data };
+  int ret = fwrite(&ev, sizeof(ev), 1, rec_fp);
+  Assert(ret == 1, "Can not write the record log");
+}
+
+static void rec_close() {
+  if (rec_mode == REC_RECORD) {
+    rec_log(REC_END, 0);
+  }
+  fclose(rec_fp);
+}
+
+/* Consume the next event if it is of `type' at this instruction. Events
+ * at the same instruction are consumed in the order they are recorded.
+ */
+bool rec_replay(int type, uint32_t *data) {
+  if (is_end) {
+    return false;
+  }
+  Assert(next.instr >= nr_guest_instr,
+      "Replay diverges: the %s event at %" PRIu64 " instructions is not consumed, now at %" PRIu64,
+      rec_name[next.type], next.instr, nr_guest_instr);
+  if (next.instr != nr_guest_instr || next.type != type) {
+    return false;
+  }
+
+  if (data != NULL) {
+    *data = next.data;
+  }
+  if (type == REC_END) {
+    is_end = true;
+  }
+  else {
+    read_next();
+  }
+  return true;
+}
+
+/* the instruction of the next event to replay */
+uint64_t rec_next_instr() {
+  return (is_end ? UINT64_MAX : next.instr);
+}
+
+/* A value read from the host, such as the time. Only the changes of the
+ * value are logged, since the guest may read it in a tight loop.
+ */
+uint32_t rec_value(int type, uint32_t val) {
+  switch (rec_mode) {
+    case REC_RECORD:
+      if (!has_value[type] || last_value[type] != val) {
+        rec_log(type, val);
+      }
+      break;
+    case REC_REPLAY:
+      if (!rec_replay(type, &val)) {
+        Assert(has_value[type], "Replay diverges: no %s event at %" PRIu64 " instructions",
+            rec_name[type], nr_guest_instr);
+        val = last_value[type];
+      }
+      break;
+    default: return val;
+  }
+
+  has_value[type] = true;
+  last_value[type] = val;
+  return val;
+}
+
+void init_record(const char *file, bool is_replay) {
+  rec_fp = fopen(file, is_replay ? "rb" : "wb");
+  Assert(rec_fp != NULL, "Can not open '%s'", file);
+
+  char magic[sizeof(REC_MAGIC) - 1];
+  if (is_replay) {
+    int ret = fread(magic, sizeof(magic), 1, rec_fp);
+    Assert(ret == 1 && memcmp(magic, REC_MAGIC, sizeof(magic)) == 0, "'%s' is not a record log", file);
+    rec_mode = REC_REPLAY;
+    read_next();
+  }
+  else {
+    int ret = fwrite(REC_MAGIC, sizeof(magic), 1, rec_fp);
+    Assert(ret == 1, "Can not write the record log");
+    rec_mode = REC_RECORD;
+  }
+
+  atexit(rec_close);
+  Log("%s the inputs %s '%s'", is_replay ? "Replaying" : "Recording", is_replay ? "from" : "to", file);
+}
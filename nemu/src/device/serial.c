@@ -1,29 +1,199 @@
 #include "common.h"
 #include "device/port-io.h"
+#include "device/device.h"
+#include "device/record.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
 
 #define SERIAL_PORT 0x3F8
 #define CH_OFFSET 0
+#define LCR_OFFSET 3		/* line control register */
 #define LSR_OFFSET 5		/* line status register */
 
+#define LCR_DLAB 0x80		/* CH_OFFSET is the divisor latch */
+#define LSR_DR   0x01		/* data ready */
+#define LSR_THRE 0x20		/* transmitter holding register empty */
+#define LSR_TEMT 0x40		/* transmitter empty */
+
 static uint8_t *serial_port_base;
 
+/* We bind the serial port with the host stdout in NEMU. The output is
+ * buffered, and written by write(2) when the buffer is full, at each
+ * timer tick, at exit, or when NEMU aborts.
+ */
+#define TX_BUF_SIZE 4096
+static char tx_buf[TX_BUF_SIZE];
+static int nr_tx = 0;
+
+/* The received bytes from the host wait in a FIFO until the guest reads
+ * them. It is refilled at each timer tick.
+ */
+#define RX_FIFO_SIZE 1024
+static uint8_t rx_fifo[RX_FIFO_SIZE];
+static int rx_f = 0, rx_r = 0;
+static int rx_fd = -1;
+
+void serial_flush() {
+  if (nr_tx == 0) {
+    return;
+  }
+
+  /* keep the order with the output of NEMU itself */
+  fflush(stdout);
+
+  char *p = tx_buf;
+  while (nr_tx > 0) {
+    int ret = write(STDOUT_FILENO, p, nr_tx);
+    if (ret > 0) {
+      p += ret;
+      nr_tx -= ret;
+    }
+    else if (ret == -1 && errno == EINTR) {
+      /* interrupted by the timer signal */
+      continue;
+    }
+    else if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      /* stdout is non-blocking, wait until it can be written */
+      struct pollfd pfd = { .fd = STDOUT_FILENO, .events = POLLOUT };
+      poll(&pfd, 1, -1);
+    }
+    else {
+      Log("Can not write the output of the serial port: %s, %d bytes dropped",
+          (ret == 0 ? "nothing written" : strerror(errno)), nr_tx);
+      nr_tx = 0;
+    }
+  }
+}
+
+/* panic() and Assert() abort, which skips the functions of atexit(), so
+ * the output just before the crash is flushed here. The default action
+ * is taken after the handler returns. */
+static void serial_abort_handler(int signum) {
+  serial_flush();
+  raise(signum);
+}
+
+static inline bool rx_is_empty() {
+  return rx_f == rx_r;
+}
+
+static void rx_refill() {
+  if (rec_mode == REC_REPLAY) {
+    uint32_t byte;
+    while ((rx_r + 1) % RX_FIFO_SIZE != rx_f && rec_replay(REC_SERIAL, &byte)) {
+      rx_fifo[rx_r] = byte;
+      rx_r = (rx_r + 1) % RX_FIFO_SIZE;
+    }
+    return;
+  }
+
+  while (rx_fd != -1) {
+    int r_next = (rx_r + 1) % RX_FIFO_SIZE;
+    if (r_next == rx_f) {
+      /* full */
+      return;
+    }
+
+    struct pollfd pfd = { .fd = rx_fd, .events = POLLIN };
+    if (poll(&pfd, 1, 0) <= 0) {
+      return;
+    }
+
+    /* read at most up to the end of the FIFO storage */
+    int len = (rx_r < rx_f ? rx_f - 1 : RX_FIFO_SIZE - (rx_f == 0)) - rx_r;
+    int ret = read(rx_fd, rx_fifo + rx_r, len);
+    if (ret <= 0) {
+      /* end of file */
+      if (rx_fd != STDIN_FILENO) {
+        close(rx_fd);
+      }
+      rx_fd = -1;
+      return;
+    }
+    if (rec_mode == REC_RECORD) {
+      int i;
+      for (i = 0; i < ret; i ++) {
+        rec_log(REC_SERIAL, rx_fifo[rx_r + i]);
+      }
+    }
+    rx_r = (rx_r + ret) % RX_FIFO_SIZE;
+  }
+}
+
+static inline void update_lsr() {
+  if (rx_is_empty()) {
+    serial_port_base[LSR_OFFSET] &= ~LSR_DR;
+  }
+  else {
+    serial_port_base[LSR_OFFSET] |= LSR_DR;
+  }
+}
+
 void serial_io_handler(ioaddr_t addr, int len, bool is_write) {
+  bool is_dlab = (serial_port_base[LCR_OFFSET] & LCR_DLAB) != 0;
   if (is_write) {
     assert(len == 1);
-    if (addr == SERIAL_PORT + CH_OFFSET) {
-      char c = serial_port_base[CH_OFFSET];
-      /* We bind the serial port with the host stdout in NEMU. */
-      putc(c, stdout);
-      if (c == '\n') {
-        fflush(stdout);
+    if (addr == SERIAL_PORT + CH_OFFSET && !is_dlab) {
+      tx_buf[nr_tx ++] = serial_port_base[CH_OFFSET];
+      device_poll(false);
+      if (nr_tx == TX_BUF_SIZE) {
+        serial_flush();
       }
     }
   }
+  else {
+    if (addr == SERIAL_PORT + CH_OFFSET && !is_dlab) {
+      if (rx_is_empty()) {
+        serial_port_base[CH_OFFSET] = 0;
+      }
+      else {
+        serial_port_base[CH_OFFSET] = rx_fifo[rx_f];
+        rx_f = (rx_f + 1) % RX_FIFO_SIZE;
+      }
+    }
+    update_lsr();
+    if (addr == SERIAL_PORT + LSR_OFFSET) {
+      device_poll(rx_is_empty());
+    }
+  }
+}
+
+/* called at each timer tick */
+void serial_update() {
+  serial_flush();
+  rx_refill();
+  update_lsr();
 }
 
-void init_serial() {
-  serial_port_base = add_pio_map(SERIAL_PORT, 8, serial_io_handler);
-  serial_port_base[LSR_OFFSET] = 0x20; /* the status is always free */
+/* `file' is the input of the serial port, "-" means stdin */
+void init_serial(const char *file) {
+  serial_port_base = add_pio_map("serial", SERIAL_PORT, 8, serial_io_handler);
+  serial_port_base[LSR_OFFSET] = LSR_THRE | LSR_TEMT; /* the transmitter is always free */
+  atexit(serial_flush);
+
+  struct sigaction s;
+  memset(&s, 0, sizeof(s));
+  s.sa_handler = serial_abort_handler;
+  s.sa_flags = SA_RESETHAND;
+  int ret = sigaction(SIGABRT, &s, NULL);
+  Assert(ret == 0, "Can not set signal handler");
+
+  /* the input is in the log when replaying */
+  if (file != NULL && rec_mode != REC_REPLAY) {
+    if (strcmp(file, "-") == 0) {
+      rx_fd = STDIN_FILENO;
+    }
+    else {
+      rx_fd = open(file, O_RDONLY);
+      Assert(rx_fd != -1, "Can not open '%s'", file);
+    }
+  }
+  rx_refill();
+  update_lsr();
 }
@@ -1,4 +1,7 @@
 #include "device/port-io.h"
+#include "device/intc.h"
+#include "device/device.h"
+#include "device/record.h"
 #include "monitor/monitor.h"
 #include <sys/time.h>
 
@@ -6,23 +9,55 @@
 
 void timer_intr() {
   if (nemu_state == NEMU_RUNNING) {
-    extern void dev_raise_intr(void);
-    dev_raise_intr();
+    intc_raise(IRQ_TIMER);
   }
 }
 
 static uint32_t *rtc_port_base;
 
+/* With the virtual clock, the time is derived from the number of guest
+ * instructions executed, as if the CPU ran at `vclock_mips' MIPS. It
+ * starts from 0, so every run sees the same time.
+ */
+static uint32_t vclock_mips = 0;
+/* instructions skipped by fast-forwarding an idle guest */
+static uint64_t vclock_skipped = 0;
+
+uint64_t vclock_instr() {
+  return nr_guest_instr + vclock_skipped;
+}
+
+void vclock_skip(uint64_t n) {
+  vclock_skipped += n;
+}
+
+/* 0 if the timer is driven by the host */
+uint32_t vclock_get_mips() {
+  return vclock_mips;
+}
+
 void rtc_io_handler(ioaddr_t addr, int len, bool is_write) {
-  if (!is_write) {
+  if (!is_write && vclock_mips != 0) {
+    rtc_port_base[0] = vclock_instr() / (vclock_mips * 1000);
+  }
+  else if (!is_write) {
     struct timeval now;
     gettimeofday(&now, NULL);
     uint32_t seconds = now.tv_sec;
     uint32_t useconds = now.tv_usec;
     rtc_port_base[0] = seconds * 1000 + (useconds + 500) / 1000;
   }
+  if (!is_write) {
+    rtc_port_base[0] = rec_value(REC_RTC, rtc_port_base[0]);
+    /* reading the time in a loop is waiting for the time */
+    device_poll(true);
+  }
+}
+
+void init_vclock(uint32_t mips) {
+  vclock_mips = mips;
 }
 
 void init_timer() {
-  rtc_port_base = add_pio_map(RTC_PORT, 4, rtc_io_handler);
+  rtc_port_base = add_pio_map("rtc", RTC_PORT, 4, rtc_io_handler);
 }
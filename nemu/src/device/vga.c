@@ -3,36 +3,133 @@
 #ifdef HAS_IOE
 
 #include "device/mmio.h"
-#include <SDL2/SDL.h>
+#include "device/display.h"
+#include <pthread.h>
+#include <sys/time.h>
 
 #define VMEM 0x40000
 
-#define SCREEN_H 300
-#define SCREEN_W 400
-
-static SDL_Window *window;
-static SDL_Renderer *renderer;
-static SDL_Texture *texture;
+/* wait for a frame at most this long, then go back to poll input events */
+#define PRESENT_WAIT_MS 5
 
 static uint32_t (*vmem) [SCREEN_W];
 
+/* Scanlines written since the last update. Only they are uploaded
+ * to the display, and nothing is presented if there is none. */
+static bool is_line_dirty[SCREEN_H];
+static int nr_dirty_line = 0;
+
+/* The screen is presented by the display thread. At each VGA tick the CPU
+ * thread copies the dirty scanlines into the back snapshot, and hands it
+ * over if the display thread has finished with the front one. Otherwise the
+ * scanlines keep accumulating in the back snapshot, so the CPU thread
+ * never waits for the presentation.
+ */
+typedef struct {
+  uint32_t pixels[SCREEN_H][SCREEN_W];
+  bool is_line_dirty[SCREEN_H];
+} Snapshot;
+
+static Snapshot snapshot[2];
+static int back = 0;
+static bool has_frame = false;
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frame_cond = PTHREAD_COND_INITIALIZER;
+
+/* mark the scanlines of [addr, addr + len), which may be many lines
+ * for a DMA write */
+static inline void mark_lines_dirty(paddr_t addr, int len) {
+  int y = (addr - VMEM) / sizeof(vmem[0]);
+  int y_end = (addr + len - 1 - VMEM) / sizeof(vmem[0]);
+  for (; y <= y_end && y < SCREEN_H; y ++) {
+    if (!is_line_dirty[y]) {
+      is_line_dirty[y] = true;
+      nr_dirty_line ++;
+    }
+  }
+}
+
 void vga_vmem_io_handler(paddr_t addr, int len, bool is_write) {
+  if (is_write) {
+    mark_lines_dirty(addr, len);
+  }
 }
 
+/* called by the CPU thread */
 void update_screen() {
-  SDL_UpdateTexture(texture, NULL, vmem, SCREEN_W * sizeof(vmem[0][0]));
-  SDL_RenderClear(renderer);
-  SDL_RenderCopy(renderer, texture, NULL, NULL);
-  SDL_RenderPresent(renderer);
+  if (nr_dirty_line == 0) {
+    return;
+  }
+
+  Snapshot *s = &snapshot[back];
+  int y;
+  for (y = 0; y < SCREEN_H; y ++) {
+    if (is_line_dirty[y]) {
+      memcpy(s->pixels[y], vmem[y], sizeof(vmem[0]));
+      s->is_line_dirty[y] = true;
+      is_line_dirty[y] = false;
+    }
+  }
+  nr_dirty_line = 0;
+
+  pthread_mutex_lock(&frame_lock);
+  if (!has_frame) {
+    back = !back;
+    has_frame = true;
+    pthread_cond_signal(&frame_cond);
+  }
+  pthread_mutex_unlock(&frame_lock);
+}
+
+/* called by the display thread */
+void present_screen(DisplayBackend *display) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  long nsec = now.tv_usec * 1000 + PRESENT_WAIT_MS * 1000000L;
+  struct timespec deadline = {
+    .tv_sec = now.tv_sec + nsec / 1000000000L,
+    .tv_nsec = nsec % 1000000000L,
+  };
+
+  pthread_mutex_lock(&frame_lock);
+  while (!has_frame) {
+    if (pthread_cond_timedwait(&frame_cond, &frame_lock, &deadline) != 0) { break; }
+  }
+  bool is_ready = has_frame;
+  /* the CPU thread does not touch the front snapshot until `has_frame' is cleared */
+  Snapshot *s = &snapshot[!back];
+  pthread_mutex_unlock(&frame_lock);
+
+  if (!is_ready) {
+    return;
+  }
+
+  /* pass each run of dirty scanlines to the backend */
+  int y = 0;
+  while (y < SCREEN_H) {
+    if (!s->is_line_dirty[y]) {
+      y ++;
+      continue;
+    }
+
+    int y0 = y;
+    for (; y < SCREEN_H && s->is_line_dirty[y]; y ++) {
+      s->is_line_dirty[y] = false;
+    }
+    display->update(s->pixels, y0, y - y0);
+  }
+  display->present();
+
+  pthread_mutex_lock(&frame_lock);
+  has_frame = false;
+  pthread_mutex_unlock(&frame_lock);
 }
 
 void init_vga() {
-  SDL_Init(SDL_INIT_VIDEO);
-  SDL_CreateWindowAndRenderer(SCREEN_W * 2, SCREEN_H * 2, 0, &window, &renderer);
-  SDL_SetWindowTitle(window, "NEMU");
-  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-      SDL_TEXTUREACCESS_STATIC, SCREEN_W, SCREEN_H);
+  vmem = add_mmio_map("vmem", VMEM, 0x80000, vga_vmem_io_handler);
 
-  vmem = add_mmio_map(VMEM, 0x80000, vga_vmem_io_handler);
+  /* present the initial screen */
+  memset(is_line_dirty, true, sizeof(is_line_dirty));
+  nr_dirty_line = SCREEN_H;
 }
 #endif	/* HAS_IOE */
@@ -0,0 +1,303 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/perf.h"
+#include "device/intc.h"
+#include "device/device.h"
+#include "cpu/decode.h"
+#include "libnemu.h"
+#include <stdlib.h>
+#include <setjmp.h>
+
+/* The CPU and memory of NEMU are globals. The state of an instance is
+ * kept in its handle, and switched into the globals when the instance is
+ * used, so instances do not affect each other.
+ */
+
+#define ENTRY_START 0x100000
+#define MAX_DEVICE 16
+
+typedef struct {
+  uint32_t low;
+  uint32_t high;
+  nemu_io_read_t read;
+  nemu_io_write_t write;
+  void *opaque;
+  IOStat stat;
+} Device;
+
+struct NEMU {
+  CPU_state cpu;
+  uint8_t *pmem;
+  int state;
+  int error;
+  uint64_t nr_instr, nr_load, nr_store, nr_branch;
+
+  Device pio[MAX_DEVICE];
+  Device mmio[MAX_DEVICE];
+  int nr_pio, nr_mmio;
+};
+
+/* the instance whose state is in the globals */
+static NEMU *cur = NULL;
+
+static void switch_to(NEMU *nemu) {
+  if (cur == nemu) {
+    return;
+  }
+
+  if (cur != NULL) {
+    cur->cpu = cpu;
+    cur->state = nemu_state;
+    cur->nr_instr = nr_guest_instr;
+    cur->nr_load = nr_guest_load;
+    cur->nr_store = nr_guest_store;
+    cur->nr_branch = nr_guest_branch;
+  }
+
+  cpu = nemu->cpu;
+  pmem = nemu->pmem;
+  nemu_state = nemu->state;
+  nr_guest_instr = nemu->nr_instr;
+  nr_guest_load = nemu->nr_load;
+  nr_guest_store = nemu->nr_store;
+  nr_guest_branch = nemu->nr_branch;
+  cur = nemu;
+}
+
+NEMU* nemu_create() {
+  NEMU *nemu = calloc(1, sizeof(NEMU));
+  assert(nemu != NULL);
+  nemu->pmem = calloc(PMEM_SIZE, 1);
+  assert(nemu->pmem != NULL);
+  nemu->state = NEMU_STOP;
+  nemu->cpu.eip = ENTRY_START;
+  nemu->cpu.eflags.val = 0x2;
+  nemu->cpu.cs = 0x8;
+  return nemu;
+}
+
+void nemu_destroy(NEMU *nemu) {
+  if (cur == nemu) {
+    cur = NULL;
+  }
+  free(nemu->pmem);
+  free(nemu);
+}
+
+int nemu_load(NEMU *nemu, const void *img, size_t size) {
+  if (size > PMEM_SIZE - ENTRY_START) {
+    return -1;
+  }
+
+  switch_to(nemu);
+  memcpy(guest_to_host(ENTRY_START), img, size);
+  memset(&cpu, 0, sizeof(cpu));
+  cpu.eip = ENTRY_START;
+  cpu.eflags.val = 0x2;
+  cpu.cs = 0x8;
+  nemu_state = NEMU_STOP;
+  nr_guest_instr = nr_guest_load = nr_guest_store = nr_guest_branch = 0;
+  nemu->error = 0;
+  return 0;
+}
+
+/* Assert() and panic() in nemu_run() jump back to it */
+static jmp_buf run_env;
+static bool is_running = false;
+
+void libnemu_fail() {
+  if (!is_running) {
+    abort();
+  }
+  longjmp(run_env, 1);
+}
+
+uint64_t nemu_run(NEMU *nemu, uint64_t n) {
+  switch_to(nemu);
+  if (nemu_state == NEMU_END || nemu->error || n == 0) {
+    return 0;
+  }
+
+  void cpu_exec(uint64_t);
+  uint64_t start = nr_guest_instr;
+  if (setjmp(run_env) == 0) {
+    is_running = true;
+    cpu_exec(n);
+  }
+  else {
+    /* the failing instruction is not finished */
+    perf_exec_end();
+    decoding.is_jmp = 0;
+    nemu_state = NEMU_STOP;
+    nemu->error = 1;
+  }
+  is_running = false;
+  return nr_guest_instr - start;
+}
+
+int nemu_error(NEMU *nemu) {
+  return nemu->error;
+}
+
+int nemu_is_end(NEMU *nemu) {
+  switch_to(nemu);
+  return nemu_state == NEMU_END;
+}
+
+uint64_t nemu_nr_instr(NEMU *nemu) {
+  switch_to(nemu);
+  return nr_guest_instr;
+}
+
+uint32_t nemu_get_reg(NEMU *nemu, int reg) {
+  assert(reg >= NEMU_REG_EAX && reg <= NEMU_REG_EIP);
+  switch_to(nemu);
+  return (reg == NEMU_REG_EIP ? cpu.eip : reg_l(reg));
+}
+
+void nemu_set_reg(NEMU *nemu, int reg, uint32_t val) {
+  assert(reg >= NEMU_REG_EAX && reg <= NEMU_REG_EIP);
+  switch_to(nemu);
+  if (reg == NEMU_REG_EIP) { cpu.eip = val; }
+  else { reg_l(reg) = val; }
+}
+
+static inline int in_pmem(uint32_t addr, size_t len) {
+  return addr < PMEM_SIZE && len <= PMEM_SIZE - addr;
+}
+
+int nemu_mem_read(NEMU *nemu, uint32_t addr, void *buf, size_t len) {
+  if (!in_pmem(addr, len)) {
+    return -1;
+  }
+  memcpy(buf, nemu->pmem + addr, len);
+  return 0;
+}
+
+int nemu_mem_write(NEMU *nemu, uint32_t addr, const void *buf, size_t len) {
+  if (!in_pmem(addr, len)) {
+    return -1;
+  }
+  memcpy(nemu->pmem + addr, buf, len);
+  return 0;
+}
+
+static int add_device(Device *dev, int *nr, const char *name, uint32_t addr, uint32_t len,
+    nemu_io_read_t read, nemu_io_write_t write, void *opaque) {
+  uint32_t high = addr + len - 1;
+  if (len == 0 || high < addr || *nr == MAX_DEVICE) {
+    return -1;
+  }
+
+  int i;
+  for (i = 0; i < *nr; i ++) {
+    if (addr <= dev[i].high && dev[i].low <= high) {
+      return -1;
+    }
+  }
+
+  dev[*nr] = (Device) { .low = addr, .high = high, .read = read, .write = write,
+    .opaque = opaque, .stat = { .name = name } };
+  (*nr) ++;
+  return 0;
+}
+
+int nemu_add_pio(NEMU *nemu, uint16_t port, int len,
+    nemu_io_read_t read, nemu_io_write_t write, void *opaque) {
+  if (len <= 0 || port + len > 65536) {
+    return -1;
+  }
+  return add_device(nemu->pio, &nemu->nr_pio, "pio", port, len, read, write, opaque);
+}
+
+int nemu_add_mmio(NEMU *nemu, uint32_t addr, uint32_t len,
+    nemu_io_read_t read, nemu_io_write_t write, void *opaque) {
+  return add_device(nemu->mmio, &nemu->nr_mmio, "mmio", addr, len, read, write, opaque);
+}
+
+/* The bus of the current instance. It replaces src/device/io/ and the
+ * interrupt controller, which are not in the library.
+ */
+
+static inline int find_device(Device *dev, int nr, uint32_t addr) {
+  int i;
+  for (i = 0; i < nr; i ++) {
+    if (addr >= dev[i].low && addr <= dev[i].high) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static inline uint32_t device_read(Device *d, uint32_t addr, int len) {
+  d->stat.nr_read ++;
+  return (d->read == NULL ? 0 : d->read(d->opaque, addr, len));
+}
+
+static inline void device_write(Device *d, uint32_t addr, int len, uint32_t data) {
+  d->stat.nr_write ++;
+  if (d->write != NULL) {
+    d->write(d->opaque, addr, len, data);
+  }
+}
+
+uint32_t pio_read(ioaddr_t addr, int len) {
+  int i = find_device(cur->pio, cur->nr_pio, addr);
+  return (i == -1 ? 0 : device_read(&cur->pio[i], addr, len));
+}
+
+void pio_write(ioaddr_t addr, int len, uint32_t data) {
+  int i = find_device(cur->pio, cur->nr_pio, addr);
+  if (i != -1) {
+    device_write(&cur->pio[i], addr, len, data);
+  }
+}
+
+int is_mmio(paddr_t addr) {
+  return (cur->nr_mmio == 0 ? -1 : find_device(cur->mmio, cur->nr_mmio, addr));
+}
+
+uint32_t mmio_read(paddr_t addr, int len, int map_NO) {
+  return device_read(&cur->mmio[map_NO], addr, len);
+}
+
+void mmio_write(paddr_t addr, int len, uint32_t data, int map_NO) {
+  device_write(&cur->mmio[map_NO], addr, len, data);
+}
+
+int nr_pio_stat() {
+  return (cur == NULL ? 0 : cur->nr_pio);
+}
+
+const IOStat* pio_stat(int i) {
+  return &cur->pio[i].stat;
+}
+
+int nr_mmio_stat() {
+  return (cur == NULL ? 0 : cur->nr_mmio);
+}
+
+const IOStat* mmio_stat(int i) {
+  return &cur->mmio[i].stat;
+}
+
+/* there is no interrupt controller */
+int intc_ack() {
+  return -1;
+}
+
+void intc_stat(int irq, const char **name, uint64_t *raised, uint64_t *acked) {
+  *name = "none";
+  *raised = *acked = 0;
+}
+
+/* `hlt' gives control back to the user, since nothing in the guest can
+ * wake it up
+ */
+void device_idle() {
+  nemu_state = NEMU_STOP;
+}
+
+uint64_t vclock_instr() {
+  return nr_guest_instr;
+}
@@ -1,21 +1,35 @@
 #include "nemu.h"
-
-#define PMEM_SIZE (128 * 1024 * 1024)
+#include "device/mmio.h"
 
 #define pmem_rw(addr, type) *(type *)({\
     Assert(addr < PMEM_SIZE, "physical address(0x%08x) is out of bound", addr); \
     guest_to_host(addr); \
     })
 
-uint8_t pmem[PMEM_SIZE];
+static uint8_t pmem_storage[PMEM_SIZE];
+uint8_t *pmem = pmem_storage;
 
 /* Memory accessing interfaces */
 
 uint32_t paddr_read(paddr_t addr, int len) {
+  int map_NO = is_mmio(addr);
+  if (map_NO != -1) {
+    return mmio_read(addr, len, map_NO);
+  }
   return pmem_rw(addr, uint32_t) & (~0u >> ((4 - len) << 3));
 }
 
 void paddr_write(paddr_t addr, int len, uint32_t data) {
+  int map_NO = is_mmio(addr);
+  if (map_NO != -1) {
+    mmio_write(addr, len, data, map_NO);
+    return;
+  }
+
+#ifdef DIFF_TEST
+  void difftest_log_write(paddr_t, int);
+  difftest_log_write(addr, len);
+#endif
   memcpy(guest_to_host(addr), &data, len);
 }
 
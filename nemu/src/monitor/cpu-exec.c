@@ -1,5 +1,7 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
+#include "monitor/perf.h"
+#include "cpu/decode.h"
 
 /* The assembly code of instructions executed is only output to the screen
  * when the number of instructions executed is less than this value.
@@ -9,9 +11,36 @@
 #define MAX_INSTR_TO_PRINT 10
 
 int nemu_state = NEMU_STOP;
+uint64_t nr_guest_instr = 0;
+uint64_t nr_guest_load = 0, nr_guest_store = 0, nr_guest_branch = 0;
+
+volatile int cpu_exit_request = 0;
+uint64_t cpu_exit_instr = 0;
 
 void exec_wrapper(bool);
 
+#ifdef HAS_IOE
+static void cpu_exit() {
+  /* a request made from now on is served next time */
+  __atomic_store_n(&cpu_exit_request, 0, __ATOMIC_RELAXED);
+
+  extern void device_update();
+  device_update();
+
+  if (cpu.INTR) {
+    /* interrupts are only taken at the end of basic blocks */
+    if (cpu.eip != decoding.seq_eip) {
+      extern void check_intr();
+      check_intr();
+    }
+
+    /* not taken yet, try again at the end of the next basic block,
+     * or when IF is set if it is masked now */
+    if (cpu.INTR && cpu.eflags.IF) { cpu_request_exit(); }
+  }
+}
+#endif
+
 /* Simulate how the CPU works. */
 void cpu_exec(uint64_t n) {
   if (nemu_state == NEMU_END) {
@@ -21,11 +50,13 @@ void cpu_exec(uint64_t n) {
   nemu_state = NEMU_RUNNING;
 
   bool print_flag = n < MAX_INSTR_TO_PRINT;
+  perf_exec_begin();
 
   for (; n > 0; n --) {
     /* Execute one instruction, including instruction fetch,
      * instruction decode, and the actual execution. */
     exec_wrapper(print_flag);
+    nr_guest_instr ++;
 
 #ifdef DEBUG
     /* TODO: check watchpoints here. */
@@ -33,12 +64,23 @@ void cpu_exec(uint64_t n) {
 #endif
 
 #ifdef HAS_IOE
-    extern void device_update();
-    device_update();
+    /* Nothing is checked for the devices and interrupts on the other
+     * instructions. A jump ends a basic block.
+     */
+    if ((cpu_exit_request && cpu.eip != decoding.seq_eip) || nr_guest_instr >= cpu_exit_instr) {
+      cpu_exit();
+    }
 #endif
 
-    if (nemu_state != NEMU_RUNNING) { return; }
+    if (nemu_state != NEMU_RUNNING) { break; }
   }
 
+#ifdef HAS_IOE
+  /* show the output of the guest before giving control back to the user */
+  extern void serial_flush();
+  serial_flush();
+#endif
+
+  perf_exec_end();
   if (nemu_state == NEMU_RUNNING) { nemu_state = NEMU_STOP; }
 }
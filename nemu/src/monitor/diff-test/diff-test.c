@@ -1,19 +1,32 @@
 #include "nemu.h"
+#include "cpu/decode.h"
+#include "memory/mmu.h"
 #include "monitor/monitor.h"
+#include "monitor/diff-test.h"
 #include <unistd.h>
 #include <sys/prctl.h>
 #include <signal.h>
+#include <dlfcn.h>
 
 #include "protocol.h"
 #include <stdlib.h>
 
 bool gdb_connect_qemu(void);
 bool gdb_memcpy_to_qemu(uint32_t, void *, int);
+bool gdb_memcpy_from_qemu(void *, uint32_t, int);
+bool gdb_memcrc_qemu(uint32_t, int, uint32_t *);
 bool gdb_getregs(union gdb_regs *);
 bool gdb_setregs(union gdb_regs *);
 bool gdb_si(void);
 void gdb_exit(void);
 
+/* the reference model, either QEMU over the GDB protocol
+ * or a shared library running in the same process */
+static difftest_memcpy_t ref_difftest_memcpy;
+static difftest_regcpy_t ref_difftest_regcpy;
+static difftest_exec_t ref_difftest_exec;
+static uint32_t (*ref_difftest_memcrc)(paddr_t, size_t);
+
 static bool is_skip_qemu;
 static bool is_skip_nemu;
 
@@ -63,7 +76,74 @@ static uint8_t mbr[] = {
   0x17, 0x00, 0x2c, 0x7c, 0x00, 0x00
 };
 
-void init_difftest(void) {
+static void qemu_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
+  bool ok = (direction == DIFFTEST_TO_REF ?
+      gdb_memcpy_to_qemu(addr, buf, n) : gdb_memcpy_from_qemu(buf, addr, n));
+  assert(ok == 1);
+}
+
+/* CRC-32 as computed by the qCRC packet of the GDB remote protocol */
+static uint32_t memcrc(const void *buf, size_t n) {
+  static uint32_t table[256];
+  static bool is_table_init = false;
+  if (!is_table_init) {
+    int i, j;
+    for (i = 0; i < 256; i ++) {
+      uint32_t c = (uint32_t)i << 24;
+      for (j = 0; j < 8; j ++) {
+        c = (c & 0x80000000u) ? (c << 1) ^ 0x04c11db7u : (c << 1);
+      }
+      table[i] = c;
+    }
+    is_table_init = true;
+  }
+
+  const uint8_t *p = buf;
+  uint32_t crc = 0xffffffffu;
+  for (; n > 0; n --) {
+    crc = (crc << 8) ^ table[((crc >> 24) ^ *p++) & 0xff];
+  }
+  return crc;
+}
+
+static uint32_t memcrc_by_copy(paddr_t addr, size_t n) {
+  uint8_t *buf = malloc(n);
+  assert(buf != NULL);
+  ref_difftest_memcpy(addr, buf, n, DIFFTEST_TO_DUT);
+  uint32_t crc = memcrc(buf, n);
+  free(buf);
+  return crc;
+}
+
+static uint32_t qemu_memcrc(paddr_t addr, size_t n) {
+  uint32_t crc;
+  if (gdb_memcrc_qemu(addr, n, &crc)) {
+    return crc;
+  }
+  // QEMU does not support qCRC, fall back to transfer the memory
+  return memcrc_by_copy(addr, n);
+}
+
+static void qemu_regcpy(void *regs, bool direction) {
+  union gdb_regs r;
+  gdb_getregs(&r);
+  if (direction == DIFFTEST_TO_REF) {
+    memcpy(&r, regs, sizeof(DiffRegs));
+    bool ok = gdb_setregs(&r);
+    assert(ok == 1);
+  }
+  else {
+    memcpy(regs, &r, sizeof(DiffRegs));
+  }
+}
+
+static void qemu_exec(uint64_t n) {
+  for (; n > 0; n --) {
+    gdb_si();
+  }
+}
+
+static void init_qemu(void) {
   int ppid_before_fork = getpid();
   int pid = fork();
   if (pid == -1) {
@@ -115,43 +195,454 @@ void init_difftest(void) {
     for (i = 0; i < 20; i ++) {
       gdb_si();
     }
+
+    ref_difftest_memcpy = qemu_memcpy;
+    ref_difftest_regcpy = qemu_regcpy;
+    ref_difftest_exec = qemu_exec;
+    ref_difftest_memcrc = qemu_memcrc;
   }
 }
 
-void init_qemu_reg() {
-  union gdb_regs r;
-  gdb_getregs(&r);
-  regcpy_from_nemu(r);
-  bool ok = gdb_setregs(&r);
-  assert(ok == 1);
+static void* load_ref_symbol(void *handle, const char *name) {
+  void *sym = dlsym(handle, name);
+  Assert(sym != NULL, "Can not find '%s' in the reference: %s", name, dlerror());
+  return sym;
 }
 
-void difftest_step(uint32_t eip) {
-  union gdb_regs r;
+static void init_ref_so(char *ref_so_file) {
+  void *handle = dlopen(ref_so_file, RTLD_LAZY | RTLD_DEEPBIND);
+  Assert(handle != NULL, "Can not load the reference '%s': %s", ref_so_file, dlerror());
+
+  difftest_init_t ref_difftest_init = load_ref_symbol(handle, "difftest_init");
+  ref_difftest_memcpy = load_ref_symbol(handle, "difftest_memcpy");
+  ref_difftest_regcpy = load_ref_symbol(handle, "difftest_regcpy");
+  ref_difftest_exec = load_ref_symbol(handle, "difftest_exec");
+  ref_difftest_memcrc = memcrc_by_copy;
+
+  ref_difftest_init();
+  Log("Load the reference '%s' successfully", ref_so_file);
+}
+
+/* Block-granular difftest. NEMU runs a window of instructions on its own,
+ * then the reference executes the same number of instructions and both
+ * sides are compared once. The window is either a fixed number of
+ * instructions or a basic block. NEMU keeps a checkpoint of the beginning
+ * of the window, which is the CPU state plus an undo log of memory writes.
+ * On a mismatch both sides are rolled back to the checkpoint, and the
+ * window is bisected down to the first diverging instruction.
+ *
+ * Only the pages written by NEMU in the window are compared and restored
+ * in the reference, so a wild write performed only by the reference is
+ * not detected.
+ *
+ * Pages are compared by their CRC-32. With QEMU the CRC is computed on
+ * the QEMU side, so the memory is not transferred.
+ */
+
+#define DIFFTEST_BB 0
+
+/* In the per-instruction mode, compare the pages written
+ * by NEMU with the reference after this many instructions. */
+#define MEM_CHECK_PERIOD 10000
+
+static uint64_t diff_interval = 1;
+static uint64_t nr_pending = 0;
+static bool is_replaying = false;
+
+typedef struct {
+  paddr_t addr;
+  int len;
+  bool is_dma;
+  uint32_t data;
+} MemLog;
+
+static MemLog *mem_log = NULL;
+static int nr_mem_log = 0, mem_log_size = 0;
+
+/* the ranges written by DMA, copied to the reference a range at a time */
+typedef struct {
+  paddr_t addr;
+  size_t len;
+} DmaLog;
+
+static DmaLog *dma_log = NULL;
+static int nr_dma_log = 0, dma_log_size = 0;
+
+#define NR_PAGE (PMEM_SIZE / PAGE_SIZE)
+static bool is_dirty[NR_PAGE];
+static uint32_t dirty_page[NR_PAGE];
+static int nr_dirty_page = 0;
+
+/* the checkpoint at the beginning of the window */
+static CPU_state ckpt_cpu;
+/* The registers of the reference as last read or written, and at the
+ * checkpoint. Those not in NEMU, such as EFLAGS, are only kept here. */
+static DiffRegs ref_regs, ckpt_ref_regs;
+/* the state before the instruction being checked */
+static CPU_state last_cpu;
+static int last_mem_log = 0;
+
+static inline void mark_dirty(paddr_t addr) {
+  uint32_t page = addr / PAGE_SIZE;
+  if (!is_dirty[page]) {
+    is_dirty[page] = true;
+    dirty_page[nr_dirty_page ++] = page;
+  }
+}
+
+static void mem_log_append(paddr_t addr, int len, bool is_dma) {
+  if (nr_mem_log == mem_log_size) {
+    mem_log_size = (mem_log_size == 0 ? 1024 : mem_log_size * 2);
+    mem_log = realloc(mem_log, sizeof(MemLog) * mem_log_size);
+    assert(mem_log != NULL);
+  }
+
+  MemLog *l = &mem_log[nr_mem_log ++];
+  l->addr = addr;
+  l->len = len;
+  l->is_dma = is_dma;
+  memcpy(&l->data, guest_to_host(addr), len);
+}
+
+void difftest_log_write(paddr_t addr, int len) {
+  if (addr + len > PMEM_SIZE) {
+    return;
+  }
+
+  mark_dirty(addr);
+  mark_dirty(addr + len - 1);
+
+  // in the per-instruction mode, only the writes since the last check are
+  // kept, to copy them to the reference if the check is skipped
+  mem_log_append(addr, len, false);
+}
+
+/* Called before a device writes the guest memory by DMA. The reference
+ * does not have the device, so the range is logged even in the
+ * per-instruction mode, and copied to the reference when the
+ * instruction starting the DMA is skipped.
+ */
+void difftest_log_dma(paddr_t addr, size_t len) {
+  if (len == 0) {
+    return;
+  }
+
+  if (nr_dma_log == dma_log_size) {
+    dma_log_size = (dma_log_size == 0 ? 64 : dma_log_size * 2);
+    dma_log = realloc(dma_log, sizeof(DmaLog) * dma_log_size);
+    assert(dma_log != NULL);
+  }
+  dma_log[nr_dma_log ++] = (DmaLog) { .addr = addr, .len = len };
+
+  paddr_t end = addr + len, p;
+  for (p = addr & ~PAGE_MASK; p < end; p += PAGE_SIZE) {
+    mark_dirty(p);
+  }
+
+  // the old data is only kept for rollback
+  if (diff_interval == 1) {
+    return;
+  }
+
+  for (; addr < end; addr += 4) {
+    mem_log_append(addr, (end - addr < 4 ? end - addr : 4), true);
+  }
+}
+
+static void dma_copy_to_ref(void) {
+  int i;
+  for (i = 0; i < nr_dma_log; i ++) {
+    ref_difftest_memcpy(dma_log[i].addr, guest_to_host(dma_log[i].addr), dma_log[i].len, DIFFTEST_TO_REF);
+  }
+  nr_dma_log = 0;
+}
+
+static void window_begin(void) {
+  int i;
+  for (i = 0; i < nr_dirty_page; i ++) {
+    is_dirty[dirty_page[i]] = false;
+  }
+  nr_dirty_page = 0;
+  nr_mem_log = 0;
+  nr_dma_log = 0;
+  nr_pending = 0;
+
+  ckpt_cpu = last_cpu = cpu;
+  ckpt_ref_regs = ref_regs;
+  last_mem_log = 0;
+}
+
+/* roll back the memory writes logged after `from' */
+static void mem_undo(int from) {
+  int i;
+  for (i = nr_mem_log - 1; i >= from; i --) {
+    memcpy(guest_to_host(mem_log[i].addr), &mem_log[i].data, mem_log[i].len);
+  }
+  nr_mem_log = from;
+}
+
+static void regcpy_to_ref(void) {
+  ref_difftest_regcpy(&ref_regs, DIFFTEST_TO_DUT);
+  regcpy_from_nemu(ref_regs);
+  ref_difftest_regcpy(&ref_regs, DIFFTEST_TO_REF);
+}
+
+static void restore_checkpoint(void) {
+  mem_undo(0);
+  cpu = ckpt_cpu;
+
+  /* all the registers of the reference, not only those of NEMU */
+  ref_regs = ckpt_ref_regs;
+  ref_difftest_regcpy(&ref_regs, DIFFTEST_TO_REF);
+  int i;
+  for (i = 0; i < nr_dirty_page; i ++) {
+    paddr_t addr = dirty_page[i] * PAGE_SIZE;
+    ref_difftest_memcpy(addr, guest_to_host(addr), PAGE_SIZE, DIFFTEST_TO_REF);
+  }
+
+  window_begin();
+}
+
+#define check_reg(r, name) \
+  if (r->name != cpu.name) { \
+    if (print) { \
+      printf("%s is different after executing instruction at eip = 0x%08x: " \
+          "right = 0x%08x, wrong = 0x%08x\n", str(name), eip, r->name, cpu.name); \
+    } \
+    diff = true; \
+  }
+
+static bool check_regs(DiffRegs *r, vaddr_t eip, bool print) {
   bool diff = false;
+  check_reg(r, eax);
+  check_reg(r, ecx);
+  check_reg(r, edx);
+  check_reg(r, ebx);
+  check_reg(r, esp);
+  check_reg(r, ebp);
+  check_reg(r, esi);
+  check_reg(r, edi);
+  check_reg(r, eip);
+  return !diff;
+}
+
+static bool check_mem(vaddr_t eip, bool print) {
+  bool diff = false;
+  int i;
+  for (i = 0; i < nr_dirty_page; i ++) {
+    paddr_t addr = dirty_page[i] * PAGE_SIZE;
+    if (ref_difftest_memcrc(addr, PAGE_SIZE) != memcrc(guest_to_host(addr), PAGE_SIZE)) {
+      if (print) {
+        printf("memory page at 0x%08x is different after executing instruction at eip = 0x%08x\n",
+            addr, eip);
+      }
+      diff = true;
+    }
+  }
+  return !diff;
+}
+
+static bool check_ref(vaddr_t eip, bool print) {
+  ref_difftest_regcpy(&ref_regs, DIFFTEST_TO_DUT);
+  bool ok = check_regs(&ref_regs, eip, print);
+  return check_mem(eip, print) && ok;
+}
+
+static void replay(uint64_t n, bool print_flag) {
+  void exec_wrapper(bool);
+  is_replaying = true;
+  for (; n > 0; n --) {
+    last_cpu = cpu;
+    last_mem_log = nr_mem_log;
+    exec_wrapper(print_flag);
+  }
+  is_replaying = false;
+}
+
+/* Both sides have executed `n' instructions since the checkpoint and
+ * they are different. Find out the first instruction making them diverge.
+ */
+static void bisect(uint64_t n) {
+  /* invariant: the states are the same after `lo' instructions,
+   * and different after `hi' instructions */
+  uint64_t lo = 0, hi = n;
+
+  Log("Difftest window of %lu instructions at eip = 0x%08x diverges, bisecting...",
+      (unsigned long)n, ckpt_cpu.eip);
+
+  restore_checkpoint();
+  while (hi - lo > 1) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    replay(mid - lo, false);
+    ref_difftest_exec(mid - lo);
+    if (check_ref(cpu.eip, false)) {
+      window_begin();
+      lo = mid;
+    }
+    else {
+      restore_checkpoint();
+      hi = mid;
+    }
+  }
+
+  vaddr_t eip = cpu.eip;
+  replay(1, true);
+  ref_difftest_exec(1);
+  check_ref(eip, true);
+
+  nemu_state = NEMU_END;
+}
+
+/* The reference can not execute the instruction just executed by NEMU.
+ * Check the window without it, then copy its effects to the reference.
+ */
+static void difftest_sync_skipped(void) {
+  int nr_redo = nr_mem_log - last_mem_log;
+  uint32_t *redo = malloc(sizeof(uint32_t) * (nr_redo + 1));
+  assert(redo != NULL);
+  int i;
+  for (i = 0; i < nr_redo; i ++) {
+    MemLog *l = &mem_log[last_mem_log + i];
+    memcpy(&redo[i], guest_to_host(l->addr), l->len);
+  }
+  MemLog *redo_log = &mem_log[last_mem_log];
+  CPU_state cur_cpu = cpu;
+
+  mem_undo(last_mem_log);
+  cpu = last_cpu;
+  ref_difftest_exec(nr_pending);
+  if (!check_ref(last_cpu.eip, false)) {
+    free(redo);
+    bisect(nr_pending);
+    return;
+  }
+
+  cpu = cur_cpu;
+  regcpy_to_ref();
+  for (i = 0; i < nr_redo; i ++) {
+    memcpy(guest_to_host(redo_log[i].addr), &redo[i], redo_log[i].len);
+    if (!redo_log[i].is_dma) {
+      ref_difftest_memcpy(redo_log[i].addr, &redo[i], redo_log[i].len, DIFFTEST_TO_REF);
+    }
+  }
+  free(redo);
+  dma_copy_to_ref();
+
+  window_begin();
+}
+
+static void difftest_step_window(uint32_t eip) {
+  if (is_skip_qemu || is_skip_nemu) {
+    is_skip_qemu = false;
+    is_skip_nemu = false;
+    difftest_sync_skipped();
+    return;
+  }
+
+  nr_pending ++;
+
+  bool is_window_end = (nemu_state != NEMU_RUNNING);
+  if (diff_interval == DIFFTEST_BB) {
+    is_window_end |= (cpu.eip != decoding.seq_eip);
+  }
+  else {
+    is_window_end |= (nr_pending >= diff_interval);
+  }
+
+  if (!is_window_end) {
+    last_cpu = cpu;
+    last_mem_log = nr_mem_log;
+    return;
+  }
+
+  ref_difftest_exec(nr_pending);
+  if (check_ref(eip, false)) {
+    window_begin();
+  }
+  else {
+    bisect(nr_pending);
+  }
+}
+
+void init_difftest(char *ref_so_file, char *interval) {
+  if (interval != NULL) {
+    if (strcmp(interval, "bb") == 0) {
+      diff_interval = DIFFTEST_BB;
+    }
+    else {
+      diff_interval = atoll(interval);
+      Assert(diff_interval > 0, "Invalid difftest window '%s'", interval);
+    }
+  }
+
+  if (ref_so_file == NULL) {
+    /* Fork a child process to run QEMU. */
+    init_qemu();
+  }
+  else {
+    init_ref_so(ref_so_file);
+  }
+}
+
+void difftest_memcpy_to_ref(paddr_t addr, void *buf, size_t n) {
+  ref_difftest_memcpy(addr, buf, n, DIFFTEST_TO_REF);
+}
+
+void init_ref_reg() {
+  regcpy_to_ref();
+  window_begin();
+}
+
+void difftest_step(uint32_t eip) {
+  DiffRegs r;
+
+  if (is_replaying) {
+    return;
+  }
+
+  if (diff_interval != 1) {
+    difftest_step_window(eip);
+    return;
+  }
 
   if (is_skip_nemu) {
     is_skip_nemu = false;
+    nr_mem_log = 0;
     return;
   }
 
   if (is_skip_qemu) {
-    // to skip the checking of an instruction, just copy the reg state to qemu
-    gdb_getregs(&r);
-    regcpy_from_nemu(r);
-    gdb_setregs(&r);
+    // to skip the checking of an instruction, just copy the reg state to the reference
+    regcpy_to_ref();
     is_skip_qemu = false;
+
+    // and the memory written since the last check, such as the frame
+    // pushed by an interrupt, then the memory written by DMA
+    int i;
+    for (i = 0; i < nr_mem_log; i ++) {
+      ref_difftest_memcpy(mem_log[i].addr, guest_to_host(mem_log[i].addr), mem_log[i].len, DIFFTEST_TO_REF);
+    }
+    nr_mem_log = 0;
+    dma_copy_to_ref();
     return;
   }
 
-  gdb_si();
-  gdb_getregs(&r);
+  nr_mem_log = 0;
 
-  // TODO: Check the registers state with QEMU.
-  // Set `diff` as `true` if they are not the same.
-  TODO();
+  ref_difftest_exec(1);
+  ref_difftest_regcpy(&r, DIFFTEST_TO_DUT);
 
-  if (diff) {
+  if (!check_regs(&r, eip, true)) {
     nemu_state = NEMU_END;
+    return;
+  }
+
+  nr_pending ++;
+  if (nr_pending >= MEM_CHECK_PERIOD) {
+    if (!check_mem(eip, true)) {
+      printf("memory is different within the last %d instructions\n", MEM_CHECK_PERIOD);
+      nemu_state = NEMU_END;
+    }
+    window_begin();
   }
 }
@@ -5,45 +5,193 @@
 
 static struct gdb_conn *conn;
 
+/* With USE_NOACK_MODE, which is defined by `make NOACK=1', the no-ack
+ * mode of the GDB remote protocol is turned on if QEMU advertises it in
+ * qSupported. Memory writes are then pipelined instead of waiting for
+ * each reply.
+ */
+
+/* the maximum packet size accepted by QEMU, updated by qSupported */
+static int packet_size = 4096;
+static bool is_noack = false;
+static bool has_X_packet = false;
+static bool has_qCRC_packet = true;
+
+static uint8_t* gdb_request(const char *cmd, size_t *size) {
+  gdb_send(conn, (const uint8_t *)cmd, strlen(cmd));
+  return gdb_recv(conn, size);
+}
+
+static void gdb_query_features(void) {
+  size_t size;
+  char *reply = (char *)gdb_request("qSupported", &size);
+  char *p = strstr(reply, "PacketSize=");
+  if (p != NULL) {
+    packet_size = strtol(p + strlen("PacketSize="), NULL, 16);
+  }
+#ifdef USE_NOACK_MODE
+  bool has_noack = (strstr(reply, "QStartNoAckMode+") != NULL);
+#endif
+  free(reply);
+
+#ifdef USE_NOACK_MODE
+  if (has_noack) {
+    is_noack = (strcmp(gdb_start_noack(conn), "OK") == 0);
+  }
+#endif
+
+  // probe the binary memory write packet with an empty payload
+  reply = (char *)gdb_request("X0,0:", &size);
+  has_X_packet = (strcmp(reply, "OK") == 0);
+  free(reply);
+}
+
 bool gdb_connect_qemu(void) {
   // connect to gdbserver on localhost port 1234
   while ((conn = gdb_begin_inet("127.0.0.1", 1234)) == NULL) {
     usleep(1);
   }
 
+  gdb_query_features();
+
   return true;
 }
 
-static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
-  char *buf = malloc(len * 2 + 128);
+static inline bool is_escaped(uint8_t c) {
+  return c == '$' || c == '#' || c == '}' || c == '*';
+}
+
+/* Send one `X' (binary) or `M' (hex) packet carrying as many bytes from
+ * `src' as the packet size allows. Return the number of bytes sent.
+ */
+static int gdb_send_mem_packet(uint32_t dest, uint8_t *src, int len) {
+  char *buf = malloc(packet_size + 1);
   assert(buf != NULL);
-  int p = sprintf(buf, "M0x%x,%x:", dest, len);
-  int i;
-  for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
+  // reserve space for the header and the checksum
+  int capacity = packet_size - 32;
+  int n, used, p;
+
+  if (has_X_packet) {
+    for (n = 0, used = 0; n < len; n ++) {
+      int w = (is_escaped(src[n]) ? 2 : 1);
+      if (used + w > capacity) { break; }
+      used += w;
+    }
+
+    p = sprintf(buf, "X0x%x,%x:", dest, n);
+    int i;
+    for (i = 0; i < n; i ++) {
+      if (is_escaped(src[i])) {
+        buf[p ++] = '}';
+        buf[p ++] = src[i] ^ 0x20;
+      }
+      else {
+        buf[p ++] = src[i];
+      }
+    }
+  }
+  else {
+    n = (len < capacity / 2 ? len : capacity / 2);
+    p = sprintf(buf, "M0x%x,%x:", dest, n);
+    int i;
+    for (i = 0; i < n; i ++) {
+      buf[p ++] = hex_encode(src[i] >> 4);
+      buf[p ++] = hex_encode(src[i] & 0xf);
+    }
   }
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+  gdb_send(conn, (const uint8_t *)buf, p);
   free(buf);
 
+  return n;
+}
+
+static bool gdb_recv_ok(int nr_reply) {
+  bool ok = true;
+  for (; nr_reply > 0; nr_reply --) {
+    size_t size;
+    uint8_t *reply = gdb_recv(conn, &size);
+    ok &= !strcmp((const char*)reply, "OK");
+    free(reply);
+  }
+  return ok;
+}
+
+bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
+  // without acks, several packets can be in flight before reading the replies
+  const int max_inflight = (is_noack ? 64 : 1);
+  int nr_inflight = 0;
+  bool ok = true;
+  while (len > 0) {
+    int n = gdb_send_mem_packet(dest, src, len);
+    dest += n;
+    src += n;
+    len -= n;
+
+    nr_inflight ++;
+    if (nr_inflight == max_inflight) {
+      ok &= gdb_recv_ok(nr_inflight);
+      nr_inflight = 0;
+    }
+  }
+  ok &= gdb_recv_ok(nr_inflight);
+  return ok;
+}
+
+/* Let QEMU compute the CRC-32 of a memory range with the qCRC packet,
+ * so that memory can be verified without transferring it.
+ * Return false if QEMU does not support it.
+ */
+bool gdb_memcrc_qemu(uint32_t addr, int len, uint32_t *crc) {
+  if (!has_qCRC_packet) {
+    return false;
+  }
+
+  char buf[128];
+  sprintf(buf, "qCRC:%x,%x", addr, len);
+  size_t size;
+  char *reply = (char *)gdb_request(buf, &size);
+  if (reply[0] == 'C') {
+    *crc = strtoul(reply + 1, NULL, 16);
+  }
+  else {
+    has_qCRC_packet = false;
+  }
+  free(reply);
+
+  return has_qCRC_packet;
+}
+
+static bool gdb_memcpy_from_qemu_small(void *dest, uint32_t src, int len) {
+  char buf[128];
+  sprintf(buf, "m0x%x,%x", src, len);
+  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
+  bool ok = (size == len * 2);
+  int i;
+  for (i = 0; ok && i < len; i ++) {
+    uint16_t byte = gdb_decode_hex(reply[i * 2], reply[i * 2 + 1]);
+    ok = (byte != UINT16_MAX);
+    ((uint8_t *)dest)[i] = byte;
+  }
   free(reply);
 
   return ok;
 }
 
-bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
-  const int mtu = 1500;
+bool gdb_memcpy_from_qemu(void *dest, uint32_t src, int len) {
+  // the reply is hex encoded
+  const int mtu = (packet_size - 32) / 2;
   bool ok = true;
   while (len > mtu) {
-    ok &= gdb_memcpy_to_qemu_small(dest, src, mtu);
+    ok &= gdb_memcpy_from_qemu_small(dest, src, mtu);
     dest += mtu;
     src += mtu;
     len -= mtu;
   }
-  ok &= gdb_memcpy_to_qemu_small(dest, src, len);
+  ok &= gdb_memcpy_from_qemu_small(dest, src, len);
   return ok;
 }
 
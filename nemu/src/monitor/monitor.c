@@ -1,20 +1,30 @@
 #include "nemu.h"
+#include "monitor/diff-test.h"
+#include "monitor/perf.h"
+#include "device/record.h"
 #include <unistd.h>
 
 #define ENTRY_START 0x100000
 
-void init_difftest();
 void init_regex();
 void init_wp_pool();
-void init_device();
+void init_device(const char *, const char *, const char *, const char *, const char *);
 
 void reg_test();
-void init_qemu_reg();
-bool gdb_memcpy_to_qemu(uint32_t, void *, int);
 
 FILE *log_fp = NULL;
 static char *log_file = NULL;
 static char *img_file = NULL;
+static char *diff_so_file = NULL;
+static char *diff_interval = NULL;
+static char *display_spec = NULL;
+static char *key_script = NULL;
+static char *vclock = NULL;
+static char *serial_in = NULL;
+static char *disk_img = NULL;
+static char *report_file = NULL;
+static char *record_file = NULL;
+static char *replay_file = NULL;
 static int is_batch_mode = false;
 
 static inline void init_log() {
@@ -75,31 +85,43 @@ static inline void load_img() {
   }
 
 #ifdef DIFF_TEST
-  gdb_memcpy_to_qemu(ENTRY_START, guest_to_host(ENTRY_START), size);
+  difftest_memcpy_to_ref(ENTRY_START, guest_to_host(ENTRY_START), size);
 #endif
 }
 
 static inline void restart() {
-  /* Set the initial instruction pointer. */
+  /* Set the initial instruction pointer, EFLAGS and CS. */
   cpu.eip = ENTRY_START;
+  cpu.eflags.val = 0x2;
+  cpu.cs = 0x8;
 
 #ifdef DIFF_TEST
-  init_qemu_reg();
+  init_ref_reg();
 #endif
 }
 
 static inline void parse_args(int argc, char *argv[]) {
   int o;
-  while ( (o = getopt(argc, argv, "-bl:")) != -1) {
+  while ( (o = getopt(argc, argv, "-bl:d:D:s:k:t:i:f:r:R:P:")) != -1) {
     switch (o) {
       case 'b': is_batch_mode = true; break;
       case 'l': log_file = optarg; break;
+      case 'd': diff_so_file = optarg; break;
+      case 'D': diff_interval = optarg; break;
+      case 's': display_spec = optarg; break;
+      case 'k': key_script = optarg; break;
+      case 't': vclock = optarg; break;
+      case 'i': serial_in = optarg; break;
+      case 'f': disk_img = optarg; break;
+      case 'r': report_file = optarg; break;
+      case 'R': record_file = optarg; break;
+      case 'P': replay_file = optarg; break;
       case 1:
                 if (img_file != NULL) Log("too much argument '%s', ignored", optarg);
                 else img_file = optarg;
                 break;
       default:
-                panic("Usage: %s [-b] [-l log_file] [img_file]", argv[0]);
+                panic("Usage: %s [-b] [-l log_file] [-d ref_so_file] [-D n|bb] [-s display[:arg]] [-k key_script] [-t mips] [-i serial_in] [-f disk_img] [-r report_json] [-R record_log] [-P replay_log] [img_file]", argv[0]);
     }
   }
 }
@@ -117,8 +139,8 @@ int init_monitor(int argc, char *argv[]) {
   reg_test();
 
 #ifdef DIFF_TEST
-  /* Fork a child process to perform differential testing. */
-  init_difftest();
+  /* Start the reference model to perform differential testing. */
+  init_difftest(diff_so_file, diff_interval);
 #endif
 
   /* Load the image to memory. */
@@ -133,8 +155,16 @@ int init_monitor(int argc, char *argv[]) {
   /* Initialize the watchpoint pool. */
   init_wp_pool();
 
+  /* Report the performance at exit, after the devices finish their output. */
+  init_perf(report_file, is_batch_mode);
+
+  /* Record or replay the inputs of devices. */
+  Assert(record_file == NULL || replay_file == NULL, "Can not record and replay at the same time");
+  if (record_file != NULL) { init_record(record_file, false); }
+  if (replay_file != NULL) { init_record(replay_file, true); }
+
   /* Initialize devices. */
-  init_device();
+  init_device(display_spec, key_script, vclock, serial_in, disk_img);
 
   /* Display welcome message. */
   welcome();
@@ -0,0 +1,152 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/perf.h"
+#include "device/intc.h"
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* The report of the run, shown at exit. The host time of the run is
+ * broken down into
+ *   devices  callbacks of PIO and MMIO, and the periodic device update
+ *   idle     sleeping while the guest is idle
+ *   cpu      the rest of cpu_exec()
+ * MIPS is counted with the time of cpu_exec() excluding idle time.
+ */
+uint64_t perf_device_ns = 0;
+uint64_t perf_idle_ns = 0;
+bool perf_is_on = false;
+
+static uint64_t boot_ns = 0;
+static uint64_t exec_ns = 0;
+static uint64_t exec_begin_ns = 0;
+
+static const char *json_file = NULL;
+static bool is_print = false;
+
+void perf_exec_begin() {
+  exec_begin_ns = get_host_ns();
+}
+
+void perf_exec_end() {
+  exec_ns += get_host_ns() - exec_begin_ns;
+}
+
+/* the MIPS of the host so far, excluding idle time */
+uint32_t perf_host_mips() {
+  uint64_t ns = exec_ns + (nemu_state == NEMU_RUNNING ? get_host_ns() - exec_begin_ns : 0);
+  ns -= (perf_idle_ns < ns ? perf_idle_ns : ns);
+  return (ns == 0 ? 0 : nr_guest_instr * 1000 / ns);
+}
+
+static inline double sec(uint64_t ns) {
+  return ns / 1e9;
+}
+
+static double cpu_time() {
+  struct timespec t;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void print_report(uint64_t wall_ns, uint64_t cpu_ns, double mips) {
+  printf("==== performance report ====\n");
+  printf("guest instructions: %" PRIu64 " (loads %" PRIu64 ", stores %" PRIu64 ", taken branches %" PRIu64 ")\n",
+      nr_guest_instr, nr_guest_load, nr_guest_store, nr_guest_branch);
+  printf("host time: wall %.3fs, cpu %.3fs\n", sec(wall_ns), cpu_time());
+  printf("execution: %.3fs (cpu %.3fs, devices %.3fs, idle %.3fs), %.2f MIPS\n",
+      sec(exec_ns), sec(cpu_ns), sec(perf_device_ns), sec(perf_idle_ns), mips);
+
+  printf("%-16s %14s %14s %12s\n", "device", "reads", "writes", "time(ms)");
+  int i;
+  for (i = 0; i < nr_pio_stat(); i ++) {
+    const IOStat *s = pio_stat(i);
+    printf("%-16s %14" PRIu64 " %14" PRIu64 " %12.3f\n", s->name, s->nr_read, s->nr_write, s->ns / 1e6);
+  }
+  for (i = 0; i < nr_mmio_stat(); i ++) {
+    const IOStat *s = mmio_stat(i);
+    printf("%-16s %14" PRIu64 " %14" PRIu64 " %12.3f\n", s->name, s->nr_read, s->nr_write, s->ns / 1e6);
+  }
+
+  printf("%-16s %14s %14s\n", "interrupt", "raised", "delivered");
+  for (i = 0; i < NR_IRQ_LINE; i ++) {
+    const char *name;
+    uint64_t raised, acked;
+    intc_stat(i, &name, &raised, &acked);
+    printf("%-16s %14" PRIu64 " %14" PRIu64 "\n", name, raised, acked);
+  }
+}
+
+static void json_io_stat(FILE *fp, const char *bus, const IOStat *s, bool is_first) {
+  fprintf(fp, "%s\n    {\"name\": \"%s\", \"bus\": \"%s\", \"reads\": %" PRIu64
+      ", \"writes\": %" PRIu64 ", \"ns\": %" PRIu64 "}",
+      is_first ? "" : ",", s->name, bus, s->nr_read, s->nr_write, s->ns);
+}
+
+static void write_json(uint64_t wall_ns, uint64_t cpu_ns, double mips) {
+  FILE *fp = fopen(json_file, "w");
+  if (fp == NULL) {
+    Log("Can not write the report to '%s'", json_file);
+    return;
+  }
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"guest_instr\": %" PRIu64 ",\n", nr_guest_instr);
+  fprintf(fp, "  \"guest_load\": %" PRIu64 ",\n", nr_guest_load);
+  fprintf(fp, "  \"guest_store\": %" PRIu64 ",\n", nr_guest_store);
+  fprintf(fp, "  \"guest_branch\": %" PRIu64 ",\n", nr_guest_branch);
+  fprintf(fp, "  \"wall_ns\": %" PRIu64 ",\n", wall_ns);
+  fprintf(fp, "  \"host_cpu_s\": %.6f,\n", cpu_time());
+  fprintf(fp, "  \"exec_ns\": %" PRIu64 ",\n", exec_ns);
+  fprintf(fp, "  \"cpu_ns\": %" PRIu64 ",\n", cpu_ns);
+  fprintf(fp, "  \"device_ns\": %" PRIu64 ",\n", perf_device_ns);
+  fprintf(fp, "  \"idle_ns\": %" PRIu64 ",\n", perf_idle_ns);
+  fprintf(fp, "  \"mips\": %.3f,\n", mips);
+
+  fprintf(fp, "  \"devices\": [");
+  int i;
+  for (i = 0; i < nr_pio_stat(); i ++) {
+    json_io_stat(fp, "pio", pio_stat(i), i == 0);
+  }
+  for (i = 0; i < nr_mmio_stat(); i ++) {
+    json_io_stat(fp, "mmio", mmio_stat(i), i == 0 && nr_pio_stat() == 0);
+  }
+  fprintf(fp, "\n  ],\n");
+
+  fprintf(fp, "  \"interrupts\": [");
+  for (i = 0; i < NR_IRQ_LINE; i ++) {
+    const char *name;
+    uint64_t raised, acked;
+    intc_stat(i, &name, &raised, &acked);
+    fprintf(fp, "%s\n    {\"name\": \"%s\", \"raised\": %" PRIu64 ", \"delivered\": %" PRIu64 "}",
+        i == 0 ? "" : ",", name, raised, acked);
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  fclose(fp);
+}
+
+static void perf_report() {
+  uint64_t wall_ns = get_host_ns() - boot_ns;
+  uint64_t busy_ns = exec_ns - (perf_idle_ns < exec_ns ? perf_idle_ns : exec_ns);
+  uint64_t cpu_ns = busy_ns - (perf_device_ns < busy_ns ? perf_device_ns : busy_ns);
+  double mips = (busy_ns == 0 ? 0 : nr_guest_instr * 1e3 / busy_ns);
+
+  if (is_print) {
+    print_report(wall_ns, cpu_ns, mips);
+  }
+  if (json_file != NULL) {
+    write_json(wall_ns, cpu_ns, mips);
+  }
+}
+
+/* The report is printed if `is_print' is set, and written into
+ * `json_file' in JSON if it is not NULL.
+ */
+void init_perf(const char *file, bool print) {
+  boot_ns = get_host_ns();
+  json_file = file;
+  is_print = print;
+  perf_is_on = (is_print || json_file != NULL);
+  if (perf_is_on) {
+    atexit(perf_report);
+  }
+}
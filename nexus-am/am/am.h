@@ -60,6 +60,10 @@ typedef struct _Screen {
   int width, height;
 } _Screen;
 
+typedef struct _PerfCnt {
+  uint64_t instr, load, store, branch;
+} _PerfCnt;
+
 typedef struct _Protect {
   _Area area; 
   void *ptr;
@@ -87,6 +91,12 @@ int _read_key();
 void _draw_rect(const uint32_t *pixels, int x, int y, int w, int h);
 void _draw_sync();
 extern _Screen _screen;
+uint64_t _disk_size();
+void _disk_read(void *buf, uint64_t offset, size_t len);
+void _disk_write(const void *buf, uint64_t offset, size_t len);
+uint64_t _tsc();
+unsigned long _tsc_mhz();
+void _perfcnt(_PerfCnt *cnt);
 
 // =======================================================================
 // [2] Asynchronous Extension (ASYE)
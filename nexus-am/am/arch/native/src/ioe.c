@@ -1,6 +1,8 @@
 #include <am.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
 
 static struct timeval boot_time;
 
@@ -12,11 +14,51 @@ unsigned long _uptime() {
   return seconds * 1000 + (useconds + 500) / 1000;
 }
 
+/* the TSC runs at 1MHz, in microseconds since boot */
+uint64_t _tsc() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint64_t)(now.tv_sec - boot_time.tv_sec) * 1000000 + now.tv_usec - boot_time.tv_usec;
+}
+
+unsigned long _tsc_mhz() {
+  return 1;
+}
+
+/* no counters on native */
+void _perfcnt(_PerfCnt *cnt) {
+  cnt->instr = cnt->load = cnt->store = cnt->branch = 0;
+}
+
 void gui_init();
 
+/* the disk is the file given by the environment variable AM_DISK */
+static int disk_fd = -1;
+
 void _ioe_init() {
   gui_init();
   gettimeofday(&boot_time, NULL);
+
+  const char *disk_file = getenv("AM_DISK");
+  if (disk_file != NULL) {
+    disk_fd = open(disk_file, O_RDWR);
+  }
+}
+
+uint64_t _disk_size() {
+  return (disk_fd == -1 ? 0 : lseek(disk_fd, 0, SEEK_END));
+}
+
+void _disk_read(void *buf, uint64_t offset, size_t len) {
+  if (pread(disk_fd, buf, len, offset) != len) {
+    _halt(1);
+  }
+}
+
+void _disk_write(const void *buf, uint64_t offset, size_t len) {
+  if (pwrite(disk_fd, buf, len, offset) != len) {
+    _halt(1);
+  }
 }
 
 
@@ -20,6 +20,11 @@ struct _RegSet {
 extern "C" {
 #endif
 
+// unmask a line of the interrupt controller of NEMU besides the timer (0)
+// and the keyboard (1), which are unmasked by _istatus(1): 2 is the disk
+// and 3 is the vblank
+void _intc_enable(int line);
+
 #ifdef __cplusplus
 }
 #endif
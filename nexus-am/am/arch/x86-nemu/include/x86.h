@@ -106,10 +106,30 @@ static inline void set_idt(GateDesc *idt, int size) {
   asm volatile("lidt (%0)" : : "r"(data));
 }
 
+static inline uint32_t get_cr3(void) {
+  volatile uint32_t val;
+  asm volatile("movl %%cr3, %0" : "=r"(val));
+  return val;
+}
+
 static inline void set_cr3(void *pdir) {
   asm volatile("movl %0, %%cr3" : : "r"(pdir));
 }
 
+static inline uint64_t rdtsc(void) {
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void sti(void) {
+  asm volatile("sti");
+}
+
+static inline void cli(void) {
+  asm volatile("cli");
+}
+
 static inline uint8_t inb(int port) {
   char data;
   asm volatile("inb %1, %0" : "=a"(data) : "d"((uint16_t)port));
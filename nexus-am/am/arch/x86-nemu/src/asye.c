@@ -5,13 +5,41 @@ static _RegSet* (*H)(_Event, _RegSet*) = NULL;
 
 void vecsys();
 void vecnull();
+void vecirq0();
+void vecirq1();
+void vecirq2();
+void vecirq3();
+
+/* the interrupt controller of NEMU */
+#define INTC_PORT 0x20
+#define INTC_MASK (INTC_PORT + 0x4)
+#define INTC_EOI  (INTC_PORT + 0xc)
+#define IRQ_BASE 32
+#define NR_IRQ_LINE 4
+#define IRQ_TIMER 0
+#define IRQ_KEYBOARD 1
+
+#define I8042_DATA_PORT 0x60
+#define I8042_STATUS_PORT 0x64
 
 _RegSet* irq_handle(_RegSet *tf) {
   _RegSet *next = tf;
   if (H) {
     _Event ev;
+    ev.cause = 0;
     switch (tf->irq) {
       case 0x80: ev.event = _EVENT_SYSCALL; break;
+      case IRQ_BASE ... IRQ_BASE + NR_IRQ_LINE - 1:
+        /* the controller can deliver other lines once this one is finished */
+        outl(INTC_EOI, tf->irq - IRQ_BASE);
+        if (tf->irq - IRQ_BASE == IRQ_TIMER) {
+          ev.event = _EVENT_IRQ_TIME;
+        }
+        else {
+          ev.event = _EVENT_IRQ_IODEV;
+          ev.cause = tf->irq - IRQ_BASE;
+        }
+        break;
       default: ev.event = _EVENT_ERROR; break;
     }
 
@@ -35,6 +63,16 @@ void _asye_init(_RegSet*(*h)(_Event, _RegSet*)) {
   // -------------------- system call --------------------------
   idt[0x80] = GATE(STS_TG32, KSEL(SEG_KCODE), vecsys, DPL_USER);
 
+  // -------------------- device interrupts --------------------
+  idt[IRQ_BASE + 0] = GATE(STS_IG32, KSEL(SEG_KCODE), vecirq0, DPL_KERN);
+  idt[IRQ_BASE + 1] = GATE(STS_IG32, KSEL(SEG_KCODE), vecirq1, DPL_KERN);
+  idt[IRQ_BASE + 2] = GATE(STS_IG32, KSEL(SEG_KCODE), vecirq2, DPL_KERN);
+  idt[IRQ_BASE + 3] = GATE(STS_IG32, KSEL(SEG_KCODE), vecirq3, DPL_KERN);
+
+  // let the keyboard raise its line
+  outb(I8042_STATUS_PORT, 0x60);
+  outb(I8042_DATA_PORT, 0x1);
+
   set_idt(idt, sizeof(idt));
 
   // register event handler
@@ -48,6 +86,29 @@ _RegSet *_make(_Area stack, void *entry, void *arg) {
 void _trap() {
 }
 
+/* All lines are masked and IF is clear at reset. Interrupts are enabled
+ * by unmasking the lines and setting IF. Only the timer and the keyboard
+ * are unmasked by default, other lines are added by _intc_enable(). */
+static int istatus = 0;
+static uint32_t intc_enabled = (1 << IRQ_TIMER) | (1 << IRQ_KEYBOARD);
+
+void _intc_enable(int line) {
+  intc_enabled |= 1 << line;
+  if (istatus) {
+    outl(INTC_MASK, ~intc_enabled & ((1 << NR_IRQ_LINE) - 1));
+  }
+}
+
 int _istatus(int enable) {
-  return 0;
+  int old = istatus;
+  istatus = (enable != 0);
+  if (istatus) {
+    outl(INTC_MASK, ~intc_enabled & ((1 << NR_IRQ_LINE) - 1));
+    sti();
+  }
+  else {
+    cli();
+    outl(INTC_MASK, (1 << NR_IRQ_LINE) - 1);
+  }
+  return old;
 }
@@ -12,6 +12,35 @@ unsigned long _uptime() {
   return 0;
 }
 
+#define PERFCNT_PORT 0x200   // Note that this is not standard
+#define PERFCNT_REG_INSTR   0x00
+#define PERFCNT_REG_LOAD    0x08
+#define PERFCNT_REG_STORE   0x10
+#define PERFCNT_REG_BRANCH  0x18
+#define PERFCNT_REG_TSC_MHZ 0x20
+
+/* reading the low half takes a snapshot for the high half */
+static uint64_t perfcnt_read(int reg) {
+  uint32_t lo = inl(PERFCNT_PORT + reg);
+  uint32_t hi = inl(PERFCNT_PORT + reg + 4);
+  return ((uint64_t)hi << 32) | lo;
+}
+
+uint64_t _tsc() {
+  return rdtsc();
+}
+
+unsigned long _tsc_mhz() {
+  return inl(PERFCNT_PORT + PERFCNT_REG_TSC_MHZ);
+}
+
+void _perfcnt(_PerfCnt *cnt) {
+  cnt->instr = perfcnt_read(PERFCNT_REG_INSTR);
+  cnt->load = perfcnt_read(PERFCNT_REG_LOAD);
+  cnt->store = perfcnt_read(PERFCNT_REG_STORE);
+  cnt->branch = perfcnt_read(PERFCNT_REG_BRANCH);
+}
+
 uint32_t* const fb = (uint32_t *)0x40000;
 
 _Screen _screen = {
@@ -21,15 +50,75 @@ _Screen _screen = {
 
 extern void* memcpy(void *, const void *, int);
 
+#define BLIT_MMIO 0xc1000
+#define BLIT_REG_OP        0
+#define BLIT_REG_SRC       1
+#define BLIT_REG_SRC_PITCH 2
+#define BLIT_REG_DST       3
+#define BLIT_REG_DST_PITCH 4
+#define BLIT_REG_W         5
+#define BLIT_REG_H         6
+#define BLIT_REG_COLOR     7
+#define BLIT_REG_CMD       8
+#define BLIT_REG_STATUS    9
+#define BLIT_OP_COPY 0
+#define BLIT_CMD_START 1
+
+static volatile uint32_t * const blit_regs = (uint32_t *)BLIT_MMIO;
+
+/* copy a rectangle by the blitter of NEMU, `src' and `dst' are physical addresses */
+static int blit_copy(uint32_t src, int src_pitch, uint32_t dst, int dst_pitch, int w, int h) {
+  blit_regs[BLIT_REG_OP] = BLIT_OP_COPY;
+  blit_regs[BLIT_REG_SRC] = src;
+  blit_regs[BLIT_REG_SRC_PITCH] = src_pitch;
+  blit_regs[BLIT_REG_DST] = dst;
+  blit_regs[BLIT_REG_DST_PITCH] = dst_pitch;
+  blit_regs[BLIT_REG_W] = w;
+  blit_regs[BLIT_REG_H] = h;
+  blit_regs[BLIT_REG_CMD] = BLIT_CMD_START;
+  return blit_regs[BLIT_REG_STATUS] == 0;
+}
+
+extern int vme_enable;
+
+/* the physical address of `va', or 0 if it is not mapped */
+static uint32_t va2pa(const void *va) {
+  if (!vme_enable) {
+    return (uint32_t)va;
+  }
+  /* the page tables are in the kernel, which is identically mapped */
+  PDE pde = ((PDE *)PTE_ADDR(get_cr3()))[PDX(va)];
+  if ((pde & PTE_P) == 0) {
+    return 0;
+  }
+  PTE pte = ((PTE *)PTE_ADDR(pde))[PTX(va)];
+  if ((pte & PTE_P) == 0) {
+    return 0;
+  }
+  return PTE_ADDR(pte) | OFF(va);
+}
+
 void _draw_rect(const uint32_t *pixels, int x, int y, int w, int h) {
-  int len = sizeof(uint32_t) * ( (x + w >= _screen.width) ? _screen.width - x : w );
+  int cw = (x + w >= _screen.width) ? _screen.width - x : w;
+  int ch = (y + h >= _screen.height) ? _screen.height - y : h;
+  if (cw <= 0 || ch <= 0) {
+    return;
+  }
   uint32_t *p_fb = &fb[y * _screen.width + x];
-  for (int j = 0; j < h; j ++) {
-    if (y + j < _screen.height) {
-      memcpy(p_fb, pixels, len);
-    }
-    else {
-      break;
+
+  if (!vme_enable &&
+      blit_copy((uint32_t)pixels, w, (uint32_t)p_fb, _screen.width, cw, ch)) {
+    return;
+  }
+
+  /* With paging, the pixels may not be physically contiguous. Blit the
+   * rows which are, and copy the others. */
+  for (int j = 0; j < ch; j ++) {
+    uint32_t pa = va2pa(pixels);
+    uint32_t pa_end = va2pa(pixels + cw - 1);
+    if (pa == 0 || pa_end - pa != (cw - 1) * sizeof(uint32_t) ||
+        !blit_copy(pa, w, (uint32_t)p_fb, _screen.width, cw, 1)) {
+      memcpy(p_fb, pixels, cw * sizeof(uint32_t));
     }
     p_fb += _screen.width;
     pixels += w;
@@ -42,3 +131,69 @@ void _draw_sync() {
 int _read_key() {
   return _KEY_NONE;
 }
+
+#define DISK_MMIO 0xc0000
+#define DISK_REG_SIZE_LO 0
+#define DISK_REG_SIZE_HI 1
+#define DISK_REG_DESC    2
+#define DISK_REG_CMD     3
+#define DISK_REG_STATUS  4
+#define DISK_CMD_START 1
+#define DISK_OP_READ  0
+#define DISK_OP_WRITE 1
+
+typedef struct {
+  uint32_t op, addr, len;
+  uint32_t offset_lo, offset_hi;
+  uint32_t next, status, pad;
+} DiskDesc;
+
+static volatile uint32_t * const disk_regs = (uint32_t *)DISK_MMIO;
+
+/* The controller only accesses physical memory, but `buf' may be a
+ * virtual address. So the data is passed through this buffer, which is
+ * mapped to the same physical address.
+ */
+#define DISK_BOUNCE_SIZE (16 * 1024)
+static uint8_t disk_bounce[DISK_BOUNCE_SIZE];
+static DiskDesc disk_desc;
+
+static void disk_transfer(int op, uint64_t offset, size_t len) {
+  disk_desc.op = op;
+  disk_desc.addr = (uint32_t)disk_bounce;
+  disk_desc.len = len;
+  disk_desc.offset_lo = offset;
+  disk_desc.offset_hi = offset >> 32;
+  disk_desc.next = 0;
+  disk_regs[DISK_REG_DESC] = (uint32_t)&disk_desc;
+  disk_regs[DISK_REG_CMD] = DISK_CMD_START;
+  if (disk_regs[DISK_REG_STATUS] != 0) {
+    _halt(1);
+  }
+}
+
+uint64_t _disk_size() {
+  return ((uint64_t)disk_regs[DISK_REG_SIZE_HI] << 32) | disk_regs[DISK_REG_SIZE_LO];
+}
+
+void _disk_read(void *buf, uint64_t offset, size_t len) {
+  while (len > 0) {
+    size_t n = (len > DISK_BOUNCE_SIZE ? DISK_BOUNCE_SIZE : len);
+    disk_transfer(DISK_OP_READ, offset, n);
+    memcpy(buf, disk_bounce, n);
+    buf += n;
+    offset += n;
+    len -= n;
+  }
+}
+
+void _disk_write(const void *buf, uint64_t offset, size_t len) {
+  while (len > 0) {
+    size_t n = (len > DISK_BOUNCE_SIZE ? DISK_BOUNCE_SIZE : len);
+    memcpy(disk_bounce, buf, n);
+    disk_transfer(DISK_OP_WRITE, offset, n);
+    buf += n;
+    offset += n;
+    len -= n;
+  }
+}
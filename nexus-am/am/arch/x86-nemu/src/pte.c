@@ -7,6 +7,9 @@ static PTE kptabs[PMEM_SIZE / PGSIZE] PG_ALIGN;
 static void* (*palloc_f)();
 static void (*pfree_f)(void*);
 
+/* whether paging is enabled by _pte_init() */
+int vme_enable = 0;
+
 _Area segments[] = {      // Kernel memory mappings
   {.start = (void*)0,          .end = (void*)PMEM_SIZE}
 };
@@ -44,6 +47,7 @@ void _pte_init(void* (*palloc)(), void (*pfree)(void*)) {
 
   set_cr3(kpdirs);
   set_cr0(get_cr0() | CR0_PG);
+  vme_enable = 1;
 }
 
 void _protect(_Protect *p) {
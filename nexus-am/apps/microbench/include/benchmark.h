@@ -91,7 +91,8 @@ extern Setting *setting;
 
 typedef struct Result {
   int pass;
-  unsigned long tsc, msec;
+  uint64_t tsc;
+  unsigned long msec;
 } Result;
 
 void prepare(Result *res);
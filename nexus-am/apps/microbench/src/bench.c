@@ -26,9 +26,11 @@ Benchmark benchmarks[] = {
 // Running a benchmark
 static void bench_prepare(Result *res) {
   res->msec = _uptime();
+  res->tsc = _tsc();
 }
 
 static void bench_done(Result *res) {
+  res->tsc = _tsc() - res->tsc;
   res->msec = _uptime() - res->msec;
 }
 
@@ -49,7 +51,27 @@ void run_once(Benchmark *b, Result *res) {
   res->pass = current->validate();
 }
 
-unsigned long score(Benchmark *b, unsigned long tsc, unsigned long msec) {
+// a / b, without the 64-bit division of libgcc, which is not linked
+static uint64_t udiv64(uint64_t a, uint64_t b) {
+  uint64_t q = 0, r = 0;
+  for (int i = 63; i >= 0; i --) {
+    r = (r << 1) | ((a >> i) & 1);
+    if (r >= b) {
+      r -= b;
+      q |= 1ull << i;
+    }
+  }
+  return q;
+}
+
+unsigned long score(Benchmark *b, uint64_t tsc, unsigned long msec) {
+  // use the TSC for a precise time, setting->ref is in microseconds
+  unsigned long mhz = _tsc_mhz();
+  if (tsc != 0 && mhz != 0) {
+    uint64_t usec = udiv64(tsc, mhz);
+    if (usec == 0) return 0;
+    return udiv64((uint64_t)REF_SCORE * setting->ref, usec);
+  }
   if (msec == 0) return 0;
   return (REF_SCORE / 1000) * setting->ref / msec;
 }
@@ -62,6 +84,9 @@ int main() {
 
   for (int i = 0; i < ARR_SIZE(benchmarks); i ++) {
     Benchmark *bench = &benchmarks[i];
+#ifdef BENCH_ONLY
+    if (strcmp(bench->name, BENCH_ONLY) != 0) continue;
+#endif
     current = bench;
     setting = &bench->settings[SETTING];
     const char *msg = bench_check(bench);
@@ -70,6 +95,7 @@ int main() {
       printk("Ignored %s\n", msg);
     } else {
       unsigned long msec = ULONG_MAX;
+      uint64_t tsc = ~0ull;
       int succ = 1;
       for (int i = 0; i < REPEAT; i ++) {
         Result res;
@@ -77,6 +103,7 @@ int main() {
         printk(res.pass ? "*" : "X");
         succ &= res.pass;
         if (res.msec < msec) msec = res.msec;
+        if (res.tsc < tsc) tsc = res.tsc;
       }
 
       if (succ) printk(" Passed.");
@@ -84,7 +111,7 @@ int main() {
 
       pass &= succ;
 
-      unsigned long cur = score(bench, 0, msec);
+      unsigned long cur = score(bench, tsc, msec);
 
       printk("\n");
       if (SETTING != 0) {
@@ -95,7 +122,9 @@ int main() {
     }
   }
 
+#ifndef BENCH_ONLY
   bench_score /= sizeof(benchmarks) / sizeof(benchmarks[0]);
+#endif
   
   printk("==================================================\n");
   printk("MicroBench %s", pass ? "PASS" : "FAIL");
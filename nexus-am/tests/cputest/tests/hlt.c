@@ -0,0 +1,24 @@
+#include "trap.h"
+
+static volatile int nr_intr = 0;
+
+static _RegSet* handler(_Event ev, _RegSet *regs) {
+  nr_intr ++;
+  return regs;
+}
+
+int main() {
+  _asye_init(handler);
+  _istatus(1);
+
+  int i;
+  for (i = 0; i < 4; i ++) {
+    int n = nr_intr;
+    /* an interrupt wakes the CPU up, and it returns after `hlt' */
+    asm volatile("sti; hlt");
+    nemu_assert(nr_intr > n);
+  }
+
+  _istatus(0);
+  return 0;
+}